@@ -0,0 +1,613 @@
+#include "assembler.hpp"
+#include "../spimp/utils.hpp"
+#include "../spinfo/opcode.hpp"
+#include <charconv>
+
+/**
+ * Encoding of the constants in the keys they are interned by, which is enough to build them back :-
+ * <pre>
+ * char    0x03 ui4
+ * int     0x04 ui8
+ * float   0x05 ui8                 (the bits of the double)
+ * string  0x06 ui4 length, bytes
+ * array   0x07 ui4 count, keys of the items
+ * </pre>
+ * All integers are in native byte order
+ */
+template<typename T>
+static void appendRaw(string &key, T value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template<typename T>
+static T loadRaw(const char *&key) {
+    T value;
+    memcpy(&value, key, sizeof(T));
+    key += sizeof(T);
+    return value;
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static void skipSpace(std::string_view &text) {
+    size_t start = text.find_first_not_of(" \t\r");
+    text.remove_prefix(start == std::string_view::npos ? text.size() : start);
+}
+
+/**
+ * @return the text up to the next space or comment, removed from text
+ */
+static std::string_view takeWord(std::string_view &text, const char *delimiters = " \t\r;") {
+    size_t end = std::min(text.find_first_of(delimiters), text.size());
+    std::string_view word = text.substr(0, end);
+    text.remove_prefix(end);
+    return word;
+}
+
+static void appendUtf8(string &key, uint32 c) {
+    if (c < 0x80) {
+        key.push_back(static_cast<char>(c));
+    } else if (c < 0x800) {
+        key.push_back(static_cast<char>(0xC0 | c >> 6));
+        key.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else if (c < 0x10000) {
+        key.push_back(static_cast<char>(0xE0 | c >> 12));
+        key.push_back(static_cast<char>(0x80 | (c >> 6 & 0x3F)));
+        key.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    } else {
+        key.push_back(static_cast<char>(0xF0 | c >> 18));
+        key.push_back(static_cast<char>(0x80 | (c >> 12 & 0x3F)));
+        key.push_back(static_cast<char>(0x80 | (c >> 6 & 0x3F)));
+        key.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+    }
+}
+
+struct Assembler::Method {
+    struct Catch {
+        std::string_view start;
+        std::string_view end;
+        std::string_view target;
+        cpidx exception;
+        uint32 line;
+    };
+
+    /// A jump whose label was not defined yet
+    struct Fixup {
+        uint32 pc;
+        std::string_view label;
+        uint32 line;
+    };
+
+    MethodInfo info;
+    vector<uint8> code;
+    uint32 instructionCount;
+    bool hasStack;
+    bool hasClosures;
+    vector<TypeParamInfo> typeParams;
+    vector<MethodInfo::ArgInfo> args;
+    vector<MethodInfo::LocalInfo> locals;
+    vector<Catch> catches;
+    vector<MethodInfo> lambdas;
+    std::unordered_map<std::string_view, uint32> labels;
+    vector<Fixup> fixups;
+
+    void reset(cpidx name) {
+        info = {};
+        info.thisMethod = name;
+        code.clear();
+        instructionCount = 0;
+        hasStack = false;
+        hasClosures = false;
+        typeParams.clear();
+        args.clear();
+        locals.clear();
+        catches.clear();
+        lambdas.clear();
+        labels.clear();
+        fixups.clear();
+    }
+};
+
+template<typename T>
+static T *copyToArena(Arena &arena, const vector<T> &items) {
+    T *copy = arena.alloc<T>(items.size());
+    std::copy(items.begin(), items.end(), copy);
+    return copy;
+}
+
+Assembler::Assembler() = default;
+
+Assembler::~Assembler() = default;
+
+errors::AssemblyError Assembler::error(const string &msg) const {
+    return errors::AssemblyError(line, msg);
+}
+
+ElpModule Assembler::assemble(std::string_view text) {
+    ElpModule result{text.size() + 4096};
+    module = &result;
+    constantIndices.clear();
+    constants.clear();
+    globals.clear();
+    objects.clear();
+    depth = 0;
+    line = 0;
+    while (!text.empty()) {
+        size_t end = std::min(text.find('\n'), text.size());
+        line++;
+        assembleLine(text.substr(0, end));
+        text.remove_prefix(std::min(end + 1, text.size()));
+    }
+    if (depth > 0) throw error("missing .end");
+
+    ElpInfo &elp = result.getInfo();
+    Arena &arena = result.getArena();
+    elp.constantPoolCount = static_cast<ui2>(constants.size());
+    elp.constantPool = arena.alloc<CpInfo>(constants.size());
+    for (size_t i = 0; i < constants.size(); ++i) {
+        const char *key = constants[i]->data();
+        elp.constantPool[i] = buildConstant(key);
+    }
+    elp.globalsCount = static_cast<ui2>(globals.size());
+    elp.globals = copyToArena(arena, globals);
+    elp.objectsCount = static_cast<ui2>(objects.size());
+    elp.objects = copyToArena(arena, objects);
+    module = null;
+    return result;
+}
+
+void Assembler::assembleLine(std::string_view text) {
+    skipSpace(text);
+    if (text.empty() || text[0] == ';') return;
+    std::string_view word = takeWord(text);
+    if (word.back() == ':') {
+        Method &method = currentMethod("label");
+        std::string_view label = word.substr(0, word.size() - 1);
+        if (label.empty()) throw error("empty label");
+        if (!method.labels.emplace(label, static_cast<uint32>(method.code.size())).second) {
+            throw error(format("label '%.*s' is already defined", (int) label.size(), label.data()));
+        }
+        skipSpace(text);
+        if (text.empty() || text[0] == ';') return;
+        word = takeWord(text);
+    }
+    if (word[0] == '.') {
+        directive(word.substr(1), text);
+    } else {
+        instruction(word, text);
+    }
+    skipSpace(text);
+    if (!text.empty() && text[0] != ';') throw error(format("unexpected '%.*s'", (int) text.size(), text.data()));
+}
+
+Assembler::Method &Assembler::currentMethod(std::string_view what) {
+    if (depth == 0) throw error(format("%.*s outside of a method", (int) what.size(), what.data()));
+    return methods[depth - 1];
+}
+
+void Assembler::directive(std::string_view name, std::string_view &text) {
+    ElpInfo &elp = module->getInfo();
+    skipSpace(text);
+    if (name == "magic") {
+        elp.magic = static_cast<ui4>(parseInteger(text, UINT32_MAX));
+    } else if (name == "version") {
+        elp.majorVersion = static_cast<ui4>(parseInteger(text, UINT32_MAX));
+        elp.minorVersion = static_cast<ui4>(parseInteger(text, UINT32_MAX));
+    } else if (name == "module") {
+        elp.thisModule = parseConstant(text, true);
+    } else if (name == "source") {
+        elp.compiledFrom = parseConstant(text, true);
+    } else if (name == "init") {
+        elp.init = parseConstant(text, true);
+    } else if (name == "entry") {
+        elp.entry = parseConstant(text, true);
+    } else if (name == "imports") {
+        elp.imports = parseConstant(text, true);
+    } else if (name == "global") {
+        if (globals.size() == UINT16_MAX) throw error("too many globals");
+        GlobalInfo global{};
+        global.thisGlobal = parseConstant(text, false);
+        global.type = parseConstant(text, false);
+        skipSpace(text);
+        if (!text.empty() && text[0] != ';') global.flags = static_cast<ui1>(parseInteger(text, UINT8_MAX));
+        globals.push_back(global);
+    } else if (name == "method") {
+        beginMethod(parseConstant(text, true));
+    } else if (name == "type") {
+        auto type = static_cast<ui1>(parseInteger(text, UINT8_MAX));
+        if (depth > 0) {
+            methods[depth - 1].info.type = type;
+        } else {
+            elp.type = type;
+        }
+    } else if (name == "flags") {
+        currentMethod(".flags").info.accessFlags = static_cast<ui2>(parseInteger(text, UINT16_MAX));
+    } else if (name == "typeparam") {
+        Method &method = currentMethod(".typeparam");
+        if (method.typeParams.size() == UINT8_MAX) throw error("too many type params");
+        method.typeParams.push_back({parseConstant(text, true)});
+    } else if (name == "arg") {
+        Method &method = currentMethod(".arg");
+        if (method.args.size() == UINT8_MAX) throw error("too many args");
+        cpidx arg = parseConstant(text, false);
+        method.args.push_back({arg, parseConstant(text, true), {}});
+    } else if (name == "local" || name == "closure") {
+        Method &method = currentMethod(".local");
+        if (method.locals.size() == UINT16_MAX) throw error("too many locals");
+        if (name == "closure" && !method.hasClosures) {
+            method.hasClosures = true;
+            method.info.closureStart = static_cast<ui2>(method.locals.size());
+        } else if (name == "local" && method.hasClosures) {
+            throw error("locals must come before closures");
+        }
+        cpidx local = parseConstant(text, false);
+        method.locals.push_back({local, parseConstant(text, true), {}});
+    } else if (name == "stack") {
+        Method &method = currentMethod(".stack");
+        method.info.maxStack = static_cast<ui4>(parseInteger(text, UINT32_MAX));
+        method.hasStack = true;
+    } else if (name == "catch") {
+        Method &method = currentMethod(".catch");
+        if (method.catches.size() == UINT16_MAX) throw error("too many exception table entries");
+        Method::Catch entry{};
+        entry.line = line;
+        for (std::string_view *label: {&entry.start, &entry.end, &entry.target}) {
+            *label = takeWord(text);
+            if (label->empty()) throw error("expected a label");
+            skipSpace(text);
+        }
+        entry.exception = parseConstant(text, true);
+        method.catches.push_back(entry);
+    } else if (name == "end") {
+        currentMethod(".end");
+        endMethod();
+    } else {
+        throw error(format("unknown directive '.%.*s'", (int) name.size(), name.data()));
+    }
+}
+
+/**
+ * Encodes the distance from the end of the jump at pc to target
+ */
+static bool encodeJump(vector<uint8> &code, uint32 pc, uint32 target, string &problem) {
+    auto opcode = static_cast<Opcode>(code[pc]);
+    int64 next = static_cast<int64>(pc) + 3;
+    int64 distance = opcode == Opcode::JBW ? next - target : target - next;
+    if (distance < 0) {
+        problem = opcode == Opcode::JBW ? "jbw cannot jump forwards"
+                                        : format("%s cannot jump backwards, use jbw", OpcodeInfo::toString(opcode).data());
+        return false;
+    }
+    if (distance > UINT16_MAX) {
+        problem = "jump is too far";
+        return false;
+    }
+    storeBigEndian(code.data() + pc + 1, static_cast<uint16>(distance));
+    return true;
+}
+
+void Assembler::instruction(std::string_view mnemonic, std::string_view &text) {
+    Opcode opcode = OpcodeInfo::fromString(mnemonic);
+    if (opcode == Opcode::NOP && mnemonic != OpcodeInfo::toString(Opcode::NOP)) {
+        throw error(format("unknown mnemonic '%.*s'", (int) mnemonic.size(), mnemonic.data()));
+    }
+    Method &method = currentMethod("instruction");
+    auto pc = static_cast<uint32>(method.code.size());
+    method.code.push_back(static_cast<uint8>(opcode));
+    method.instructionCount++;
+    skipSpace(text);
+
+    if (opcode == Opcode::CLOSURELOAD) {
+        method.code.push_back(0);
+        uint32 count = 0;
+        for (; !text.empty() && text[0] != ';'; ++count) {
+            if (count == UINT8_MAX) throw error("too many closure params");
+            method.code.resize(method.code.size() + 2);
+            storeBigEndian(method.code.data() + method.code.size() - 2, static_cast<uint16>(parseInteger(text, UINT16_MAX)));
+            skipSpace(text);
+        }
+        method.code[pc + 1] = static_cast<uint8>(count);
+        return;
+    }
+    uint8 params = OpcodeInfo::getParams(opcode);
+    if (params == 0) return;
+
+    uint64 operand = 0;
+    if (OpcodeInfo::takeFromConstPool(opcode)) {
+        operand = parseConstant(text, true);
+        if (operand > (params == 1 ? UINT8_MAX : UINT16_MAX)) {
+            throw error(format("constant pool index %u does not fit the operand of %s", (unsigned) operand,
+                               OpcodeInfo::toString(opcode).data()));
+        }
+    } else if (!OpcodeInfo::isJump(opcode)) {
+        operand = parseInteger(text, params == 1 ? UINT8_MAX : UINT16_MAX);
+    }
+    method.code.resize(method.code.size() + params);
+    if (params == 1) {
+        method.code[pc + 1] = static_cast<uint8>(operand);
+    } else {
+        storeBigEndian(method.code.data() + pc + 1, static_cast<uint16>(operand));
+    }
+
+    if (OpcodeInfo::isJump(opcode)) {
+        std::string_view label = takeWord(text);
+        if (label.empty()) throw error("expected a label");
+        auto it = method.labels.find(label);
+        if (it == method.labels.end()) {
+            method.fixups.push_back({pc, label, line});
+            return;
+        }
+        string problem;
+        if (!encodeJump(method.code, pc, it->second, problem)) throw error(problem);
+    }
+}
+
+void Assembler::beginMethod(cpidx name) {
+    if (depth == methods.size()) methods.emplace_back();
+    methods[depth++].reset(name);
+}
+
+void Assembler::endMethod() {
+    Method &method = methods[depth - 1];
+    string problem;
+    for (const auto &fixup: method.fixups) {
+        line = fixup.line;
+        auto it = method.labels.find(fixup.label);
+        if (it == method.labels.end()) {
+            throw error(format("undefined label '%.*s'", (int) fixup.label.size(), fixup.label.data()));
+        }
+        if (!encodeJump(method.code, fixup.pc, it->second, problem)) throw error(problem);
+    }
+
+    Arena &arena = module->getArena();
+    MethodInfo &info = method.info;
+    info.typeParamCount = static_cast<ui1>(method.typeParams.size());
+    info.typeParams = copyToArena(arena, method.typeParams);
+    info.argsCount = static_cast<ui1>(method.args.size());
+    info.args = copyToArena(arena, method.args);
+    info.localsCount = static_cast<ui2>(method.locals.size());
+    if (!method.hasClosures) info.closureStart = info.localsCount;
+    info.locals = copyToArena(arena, method.locals);
+    if (!method.hasStack) info.maxStack = method.instructionCount;
+    info.codeCount = static_cast<ui4>(method.code.size());
+    info.code = copyToArena(arena, method.code);
+
+    info.exceptionTableCount = static_cast<ui2>(method.catches.size());
+    info.exceptionTable = arena.alloc<MethodInfo::ExceptionTableInfo>(method.catches.size());
+    for (size_t i = 0; i < method.catches.size(); ++i) {
+        const auto &entry = method.catches[i];
+        line = entry.line;
+        ui4 pcs[3];
+        std::string_view labels[3] = {entry.start, entry.end, entry.target};
+        for (size_t j = 0; j < 3; ++j) {
+            auto it = method.labels.find(labels[j]);
+            if (it == method.labels.end()) {
+                throw error(format("undefined label '%.*s'", (int) labels[j].size(), labels[j].data()));
+            }
+            pcs[j] = it->second;
+        }
+        info.exceptionTable[i] = {pcs[0], pcs[1], pcs[2], entry.exception, {}};
+    }
+    if (method.lambdas.size() > UINT16_MAX) throw error("too many lambdas");
+    info.lambdaCount = static_cast<ui2>(method.lambdas.size());
+    info.lambdas = copyToArena(arena, method.lambdas);
+
+    depth--;
+    if (depth > 0) {
+        methods[depth - 1].lambdas.push_back(info);
+    } else {
+        if (objects.size() == UINT16_MAX) throw error("too many objects");
+        ObjInfo obj{};
+        obj.type = 0x01;
+        obj._method = info;
+        objects.push_back(obj);
+    }
+}
+
+cpidx Assembler::parseConstant(std::string_view &text, bool last) {
+    skipSpace(text);
+    key.clear();
+    appendConstant(text, last);
+    auto [it, inserted] = constantIndices.try_emplace(key, static_cast<cpidx>(constants.size()));
+    if (inserted) {
+        if (constants.size() == UINT16_MAX) throw error("constant pool is full");
+        constants.push_back(&it->first);
+    }
+    return it->second;
+}
+
+void Assembler::appendConstant(std::string_view &text, bool last) {
+    if (text.empty() || text[0] == ';') throw error("expected a constant");
+    char c = text[0];
+    if (c == '"') {
+        appendString(text);
+    } else if (c == '\'') {
+        text.remove_prefix(1);
+        bool isByte;
+        uint32 value = parseChar(text, isByte);
+        if (text.empty() || text[0] != '\'') throw error("unterminated char");
+        text.remove_prefix(1);
+        key.push_back(0x03);
+        appendRaw<ui4>(key, value);
+    } else if (c == '[') {
+        text.remove_prefix(1);
+        key.push_back(0x07);
+        size_t countOffset = key.size();
+        appendRaw<ui4>(key, 0);
+        ui4 count = 0;
+        skipSpace(text);
+        if (!text.empty() && text[0] == ']') {
+            text.remove_prefix(1);
+        } else {
+            while (true) {
+                skipSpace(text);
+                appendConstant(text, false);
+                if (++count > UINT16_MAX) throw error("array is too long");
+                skipSpace(text);
+                if (text.empty()) throw error("unterminated array");
+                char separator = text[0];
+                text.remove_prefix(1);
+                if (separator == ']') break;
+                if (separator != ',') throw error("expected ',' or ']'");
+            }
+        }
+        memcpy(key.data() + countOffset, &count, sizeof(count));
+    } else if (isDigit(c) || ((c == '-' || c == '+') && text.size() > 1 && isDigit(text[1]))) {
+        std::string_view number = takeWord(text, " \t\r;,]");
+        bool hex = number.find("0x") != std::string_view::npos || number.find("0X") != std::string_view::npos;
+        if (!hex && number.find_first_of(".eE") != std::string_view::npos) {
+            double value;
+            auto start = number.data() + (number[0] == '+');
+            auto result = std::from_chars(start, number.data() + number.size(), value);
+            if (result.ec != std::errc() || result.ptr != number.data() + number.size()) {
+                throw error(format("invalid float '%.*s'", (int) number.size(), number.data()));
+            }
+            key.push_back(0x05);
+            appendRaw<ui8>(key, doubleToRaw(value));
+        } else {
+            bool negative = number[0] == '-';
+            if (number[0] == '-' || number[0] == '+') number.remove_prefix(1);
+            uint64 max = negative ? uint64(INT64_MAX) + 1 : uint64(INT64_MAX);
+            uint64 value = parseInteger(number, max);
+            if (!number.empty()) throw error(format("invalid int '%.*s'", (int) number.size(), number.data()));
+            key.push_back(0x04);
+            appendRaw<ui8>(key, negative ? 0 - value : value);
+        }
+    } else {
+        std::string_view symbol = takeWord(text, last ? ";" : " \t\r;,]");
+        symbol = symbol.substr(0, symbol.find_last_not_of(" \t\r") + 1);
+        if (symbol.empty()) throw error("expected a constant");
+        if (symbol.size() > UINT16_MAX) throw error("symbol is too long");
+        key.push_back(0x06);
+        appendRaw<ui4>(key, static_cast<ui4>(symbol.size()));
+        key.append(symbol);
+    }
+}
+
+void Assembler::appendString(std::string_view &text) {
+    text.remove_prefix(1);
+    key.push_back(0x06);
+    size_t lengthOffset = key.size();
+    appendRaw<ui4>(key, 0);
+    while (true) {
+        if (text.empty()) throw error("unterminated string");
+        if (text[0] == '"') break;
+        if (text[0] == '\\') {
+            bool isByte;
+            uint32 value = parseChar(text, isByte);
+            if (isByte) {
+                key.push_back(static_cast<char>(value));
+            } else {
+                appendUtf8(key, value);
+            }
+        } else {
+            key.push_back(text[0]);
+            text.remove_prefix(1);
+        }
+    }
+    text.remove_prefix(1);
+    size_t length = key.size() - lengthOffset - sizeof(ui4);
+    if (length > UINT16_MAX) throw error("string is too long");
+    auto stored = static_cast<ui4>(length);
+    memcpy(key.data() + lengthOffset, &stored, sizeof(stored));
+}
+
+uint32 Assembler::parseChar(std::string_view &text, bool &isByte) {
+    isByte = false;
+    if (text.empty()) throw error("unterminated char");
+    auto c = static_cast<uint8>(text[0]);
+    text.remove_prefix(1);
+    if (c != '\\') {
+        // Decode a UTF-8 sequence into its code point
+        size_t extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+        uint32 value = extra == 0 ? c : c & (0x3F >> extra);
+        if (text.size() < extra) throw error("invalid UTF-8");
+        for (size_t i = 0; i < extra; ++i) value = value << 6 | (static_cast<uint8>(text[i]) & 0x3F);
+        text.remove_prefix(extra);
+        return value;
+    }
+    if (text.empty()) throw error("unterminated escape");
+    c = static_cast<uint8>(text[0]);
+    text.remove_prefix(1);
+    switch (c) {
+        case 'n':
+            return '\n';
+        case 'r':
+            return '\r';
+        case 't':
+            return '\t';
+        case '0':
+            return '\0';
+        case '\\':
+        case '\'':
+        case '"':
+            return c;
+        case 'x': {
+            isByte = true;
+            std::string_view digits = text.substr(0, 2);
+            uint32 value;
+            auto result = std::from_chars(digits.data(), digits.data() + digits.size(), value, 16);
+            if (digits.size() != 2 || result.ptr != digits.data() + 2) throw error("expected two hex digits after \\x");
+            text.remove_prefix(2);
+            return value;
+        }
+        case 'u': {
+            size_t end = text.find('}');
+            if (text.empty() || text[0] != '{' || end == std::string_view::npos) throw error("expected \\u{...}");
+            uint32 value;
+            auto result = std::from_chars(text.data() + 1, text.data() + end, value, 16);
+            if (end == 1 || result.ptr != text.data() + end || value > 0x10FFFF) throw error("invalid code point");
+            text.remove_prefix(end + 1);
+            return value;
+        }
+        default:
+            throw error(format("unknown escape '\\%c'", c));
+    }
+}
+
+uint64 Assembler::parseInteger(std::string_view &text, uint64 max) {
+    skipSpace(text);
+    std::string_view number = takeWord(text, " \t\r;,]");
+    int base = 10;
+    if (number.size() > 2 && number[0] == '0' && (number[1] == 'x' || number[1] == 'X')) {
+        base = 16;
+        number.remove_prefix(2);
+    }
+    uint64 value;
+    auto result = std::from_chars(number.data(), number.data() + number.size(), value, base);
+    if (number.empty() || result.ec != std::errc() || result.ptr != number.data() + number.size() || value > max) {
+        throw error(format("expected an integer up to %llu", (unsigned long long) max));
+    }
+    return value;
+}
+
+CpInfo Assembler::buildConstant(const char *&key) {
+    auto tag = static_cast<uint8>(*key++);
+    switch (tag) {
+        case 0x03:
+            return CpInfo{.tag = 0x03, ._char = loadRaw<ui4>(key)};
+        case 0x04:
+            return CpInfo{.tag = 0x04, ._int = loadRaw<ui8>(key)};
+        case 0x05:
+            return CpInfo{.tag = 0x05, ._float = loadRaw<ui8>(key)};
+        case 0x06: {
+            __UTF8 str;
+            str.len = static_cast<ui2>(loadRaw<ui4>(key));
+            str.bytes = module->getArena().alloc<ui1>(str.len);
+            memcpy(str.bytes, key, str.len);
+            key += str.len;
+            return CpInfo{.tag = 0x06, ._string = str};
+        }
+        case 0x07: {
+            __Container array;
+            array.len = static_cast<ui2>(loadRaw<ui4>(key));
+            array.items = module->getArena().alloc<CpInfo>(array.len);
+            for (size_t i = 0; i < array.len; ++i) array.items[i] = buildConstant(key);
+            return CpInfo{.tag = 0x07, ._array = array};
+        }
+        default:
+            throw errors::Unreachable();
+    }
+}
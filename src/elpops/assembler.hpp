@@ -0,0 +1,116 @@
+#ifndef ELPOPS_ASSEMBLER_HPP
+#define ELPOPS_ASSEMBLER_HPP
+
+#include "../spimp/exceptions.hpp"
+#include "elpdef.hpp"
+#include "module.hpp"
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Assembles a module from text. Each line holds a label, a directive or an instruction,
+ * and a comment starts with ';' and runs to the end of the line.
+ * <br>
+ * An instruction is a mnemonic from OPCODE_TABLE followed by its operand :-
+ * <ul>
+ * <li>a constant if the opcode takes from the constant pool</li>
+ * <li>a label if it is a jump, see OpcodeInfo::isJump()</li>
+ * <li>any number of integers for CLOSURELOAD, whose count is filled in</li>
+ * <li>an integer fitting the params otherwise</li>
+ * </ul>
+ * A constant is an int (42, -7, 0x2A), a float (1.5, 2e10), a char ('c', '\\n', '\\u{1F600}'),
+ * a string ("text", with the same escapes and \\xHH), an array ([1, "a", [2.0]]) or a bare symbol
+ * which is stored as a string. A bare symbol runs to the end of the line when it is the last
+ * operand and to the next space otherwise. Equal constants share one entry of the constant
+ * pool, in the order they first appear.
+ * <br>
+ * A label is a name followed by ':' at the start of a line. Labels are local to their method
+ * and can be used before they are defined. Jumps to labels defined further up are encoded
+ * right away, the others when the method ends.
+ * <br>
+ * Directives :-
+ * <pre>
+ * .magic n, .version major minor      the fixed header
+ * .module c, .source c                thisModule and compiledFrom
+ * .init c, .entry c, .imports c       the other references in the header
+ * .global name type [flags]           a global
+ * .method name                        starts a method, a lambda of the enclosing method if any
+ * .type n, .flags n                   type and access flags of the current method, .type is the module type outside methods
+ * .typeparam name                     a type param of the current method
+ * .arg name type                      an arg of the current method
+ * .local name type                    a local of the current method
+ * .closure name type                  a closure local of the current method, after the other locals
+ * .stack n                            maxStack, the number of instructions if not given
+ * .catch start end target exception   an exception table entry, the pcs given as labels
+ * .end                                ends the current method
+ * </pre>
+ * Metas are left empty. The assembler keeps its tables between calls, so assembling many
+ * small programs in a row reuses their memory
+ */
+class Assembler {
+  private:
+    struct Method;
+
+    /// Constants of the module, indexed by their key, see appendConstant()
+    std::unordered_map<string, cpidx> constantIndices;
+    /// The keys of the constants in pool order, pointing into constantIndices
+    vector<const string *> constants;
+    vector<GlobalInfo> globals;
+    vector<ObjInfo> objects;
+    /// Methods being assembled, the innermost last. Popped methods are kept to reuse their memory
+    vector<Method> methods;
+    size_t depth = 0;
+    /// Scratch space for the key of the constant being parsed
+    string key;
+    ElpModule *module = null;
+    uint32 line = 0;
+
+    void assembleLine(std::string_view text);
+
+    void directive(std::string_view name, std::string_view &text);
+
+    void instruction(std::string_view mnemonic, std::string_view &text);
+
+    void beginMethod(cpidx name);
+
+    void endMethod();
+
+    Method &currentMethod(std::string_view what);
+
+    cpidx parseConstant(std::string_view &text, bool last);
+
+    void appendConstant(std::string_view &text, bool last);
+
+    void appendString(std::string_view &text);
+
+    /**
+     * Parses a character of a char or string literal, an escape sequence included
+     * @param isByte set if it is a \\x escape, which gives a byte rather than a code point
+     */
+    uint32 parseChar(std::string_view &text, bool &isByte);
+
+    uint64 parseInteger(std::string_view &text, uint64 max);
+
+    CpInfo buildConstant(const char *&key);
+
+    errors::AssemblyError error(const string &msg) const;
+
+  public:
+    Assembler();
+
+    Assembler(const Assembler &) = delete;
+
+    Assembler &operator=(const Assembler &) = delete;
+
+    ~Assembler();
+
+    /**
+     * Assembles a module
+     * @param text the source
+     * @return the module, allocated from its own arena and ready for ElpWriter
+     * @throws errors::AssemblyError if the source is invalid
+     */
+    ElpModule assemble(std::string_view text);
+};
+
+#endif    // ELPOPS_ASSEMBLER_HPP
@@ -0,0 +1,36 @@
+#include "batch.hpp"
+#include "../spimp/parallel.hpp"
+#include "writer.hpp"
+
+vector<ElpModule> ElpBatchLoader::load(const vector<string> &paths) {
+    vector<ElpModule> modules(paths.size());
+    parallelFor(paths.size(), threads, [&](size_t index, size_t) {
+        ElpReader reader{paths[index], mode};
+        reader.setStringTable(strings);
+        try {
+            modules[index] = reader.readModule();
+        } catch (...) {
+            reader.close();
+            throw;
+        }
+        reader.close();
+    });
+    return modules;
+}
+
+vector<ElpModule> ElpBatchLoader::load(const vector<string> &paths, AsyncFileIO &io) {
+    vector<ElpModule> modules(paths.size());
+    io.readFiles(paths, [&](size_t index, vector<std::byte> &data) {
+        ElpReader reader{std::span<const std::byte>(data), paths[index]};
+        reader.setStringTable(strings);
+        modules[index] = reader.readModule();
+    });
+    return modules;
+}
+
+void ElpBatchWriter::write(const vector<string> &paths, const vector<const ElpInfo *> &modules) {
+    io.writeFiles(paths, [&](size_t index, vector<std::byte> &data) {
+        ElpWriter writer{data};
+        writer.write(*modules[index]);
+    });
+}
@@ -0,0 +1,68 @@
+#ifndef ELPOPS_BATCH_HPP
+#define ELPOPS_BATCH_HPP
+
+#include "../spimp/asyncio.hpp"
+#include "../spimp/stringtable.hpp"
+#include "module.hpp"
+#include "reader.hpp"
+
+/**
+ * Loads many ELP files at once on a pool of worker threads.
+ * All strings of the loaded modules are interned into one table owned by the
+ * loader, so names shared between modules are stored once
+ */
+class ElpBatchLoader {
+  private:
+    size_t threads;
+    ElpReader::Mode mode;
+    std::shared_ptr<StringTable> strings = std::make_shared<StringTable>();
+
+  public:
+    /**
+     * @param threads number of threads, 0 for one per hardware thread
+     * @param mode how the files are accessed
+     */
+    explicit ElpBatchLoader(size_t threads = 0, ElpReader::Mode mode = ElpReader::Mode::MAPPED)
+        : threads(threads), mode(mode) {}
+
+    /**
+     * Loads the files. Modules loaded by further calls share the same string table
+     * @param paths the paths of the files
+     * @return the modules, in the order of paths
+     */
+    vector<ElpModule> load(const vector<string> &paths);
+
+    /**
+     * Loads the files like load(), but reads them whole through io. Each file is
+     * decoded on the calling thread as soon as its read completes, while the reads
+     * of the other files are still in flight
+     * @param paths the paths of the files
+     * @param io the i/o backend
+     * @return the modules, in the order of paths
+     */
+    vector<ElpModule> load(const vector<string> &paths, AsyncFileIO &io);
+
+    const std::shared_ptr<StringTable> &getStringTable() const { return strings; }
+};
+
+/**
+ * Writes many ELP files at once through an AsyncFileIO backend.
+ * Each module is encoded just before its write is submitted, so encoding
+ * overlaps with the writes already in flight
+ */
+class ElpBatchWriter {
+  private:
+    AsyncFileIO &io;
+
+  public:
+    explicit ElpBatchWriter(AsyncFileIO &io) : io(io) {}
+
+    /**
+     * Writes the modules
+     * @param paths the paths of the files
+     * @param modules the modules, modules[i] is written to paths[i]
+     */
+    void write(const vector<string> &paths, const vector<const ElpInfo *> &modules);
+};
+
+#endif    // ELPOPS_BATCH_HPP
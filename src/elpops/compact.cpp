@@ -0,0 +1,174 @@
+#include "compact.hpp"
+#include "../spimp/exceptions.hpp"
+#include "../spimp/utils.hpp"
+#include "../spinfo/bytecode.hpp"
+#include <unordered_map>
+
+/**
+ * Calls fn on every reference to the constant pool in a module, the operands of instructions included
+ */
+template<typename F>
+class PoolReferences {
+  private:
+    F &fn;
+
+    void visit(MethodInfo &method) {
+        fn(method.thisMethod);
+        for (int i = 0; i < method.typeParamCount; ++i) fn(method.typeParams[i].name);
+        for (int i = 0; i < method.argsCount; ++i) {
+            fn(method.args[i].thisArg);
+            fn(method.args[i].type);
+        }
+        for (int i = 0; i < method.localsCount; ++i) {
+            fn(method.locals[i].thisLocal);
+            fn(method.locals[i].type);
+        }
+        visitCode(method.code, method.codeCount);
+        for (int i = 0; i < method.exceptionTableCount; ++i) fn(method.exceptionTable[i].exception);
+        for (int i = 0; i < method.lambdaCount; ++i) visit(method.lambdas[i]);
+        for (int i = 0; i < method.matchCount; ++i) {
+            for (int j = 0; j < method.matches[i].caseCount; ++j) fn(method.matches[i].cases[j].value);
+        }
+    }
+
+    void visit(ClassInfo &klass) {
+        fn(klass.thisClass);
+        for (int i = 0; i < klass.typeParamCount; ++i) fn(klass.typeParams[i].name);
+        fn(klass.supers);
+        for (int i = 0; i < klass.fieldsCount; ++i) {
+            fn(klass.fields[i].thisField);
+            fn(klass.fields[i].type);
+        }
+        for (int i = 0; i < klass.methodsCount; ++i) visit(klass.methods[i]);
+        for (int i = 0; i < klass.objectsCount; ++i) visit(klass.objects[i]);
+    }
+
+    void visit(ObjInfo &obj) {
+        switch (obj.type) {
+            case 0x01:
+                visit(obj._method);
+                break;
+            case 0x02:
+                visit(obj._class);
+                break;
+            default:
+                throw errors::Unreachable();
+        }
+    }
+
+    /**
+     * Visits the operands of the instructions that take from the constant pool,
+     * the code is only written to where fn changed an operand
+     */
+    void visitCode(ui1 *code, ui4 count) {
+        for (auto &instruction: Bytecode{code, count}) {
+            if (!instruction.isConstPoolRef) continue;
+            cpidx index = instruction.operand;
+            fn(index);
+            if (index == instruction.operand) continue;
+            ui1 *param = code + instruction.pc + 1;
+            if (instruction.length == 2) {
+                *param = static_cast<ui1>(index);
+            } else {
+                storeBigEndian<ui2>(param, index);
+            }
+        }
+    }
+
+  public:
+    explicit PoolReferences(F &fn) : fn(fn) {}
+
+    void visit(ElpInfo &elp) {
+        fn(elp.compiledFrom);
+        fn(elp.thisModule);
+        fn(elp.init);
+        fn(elp.entry);
+        fn(elp.imports);
+        for (int i = 0; i < elp.globalsCount; ++i) {
+            fn(elp.globals[i].thisGlobal);
+            fn(elp.globals[i].type);
+        }
+        for (int i = 0; i < elp.objectsCount; ++i) visit(elp.objects[i]);
+    }
+};
+
+template<typename F>
+static void forEachPoolReference(ElpInfo &elp, F &&fn) {
+    PoolReferences<F> references{fn};
+    references.visit(elp);
+}
+
+/**
+ * Hashes the contents of a constant, consistently with CpInfo::operator==
+ */
+static size_t hashConstant(const CpInfo &cp) {
+    size_t hash = cp.tag;
+    auto mix = [&hash](uint64 value) { hash = (hash ^ value) * 0x100000001B3ull; };
+    switch (cp.tag) {
+        case 0x03:
+            mix(cp._char);
+            break;
+        case 0x04:
+            mix(cp._int);
+            break;
+        case 0x05:
+            mix(cp._float);
+            break;
+        case 0x06:
+            mix(cp._string.len);
+            for (int i = 0; i < cp._string.len; ++i) mix(cp._string.bytes[i]);
+            break;
+        case 0x07:
+            mix(cp._array.len);
+            for (int i = 0; i < cp._array.len; ++i) mix(hashConstant(cp._array.items[i]));
+            break;
+        default:
+            throw errors::Unreachable();
+    }
+    return hash;
+}
+
+CompactionStats compactConstantPool(ElpInfo &elp) {
+    size_t count = elp.constantPoolCount;
+    vector<bool> used(count);
+    forEachPoolReference(elp, [&](cpidx &index) {
+        if (index >= count) throw std::out_of_range(format("constant pool index %u out of range", index));
+        used[index] = true;
+    });
+
+    // Every entry is merged into the first entry equal to it, which is kept if any of them is used
+    struct Hash {
+        size_t operator()(const CpInfo *cp) const { return hashConstant(*cp); }
+    };
+
+    struct Equal {
+        bool operator()(const CpInfo *lhs, const CpInfo *rhs) const { return *lhs == *rhs; }
+    };
+
+    std::unordered_map<const CpInfo *, cpidx, Hash, Equal> firsts;
+    vector<cpidx> first(count);
+    for (size_t i = 0; i < count; ++i) {
+        first[i] = firsts.try_emplace(&elp.constantPool[i], i).first->second;
+        if (used[i]) used[first[i]] = true;
+    }
+
+    CompactionStats stats{};
+    vector<cpidx> remap(count);
+    cpidx next = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (first[i] != i) {
+            remap[i] = remap[first[i]];
+            if (used[first[i]]) stats.merged++;
+            else stats.dropped++;
+        } else if (used[i]) {
+            remap[i] = next;
+            // No entry moves up, so this never overwrites an entry that is yet to be moved
+            elp.constantPool[next++] = elp.constantPool[i];
+        } else {
+            stats.dropped++;
+        }
+    }
+    elp.constantPoolCount = next;
+    forEachPoolReference(elp, [&](cpidx &index) { index = remap[index]; });
+    return stats;
+}
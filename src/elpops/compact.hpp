@@ -0,0 +1,32 @@
+#ifndef ELPOPS_COMPACT_HPP
+#define ELPOPS_COMPACT_HPP
+
+#include "elpdef.hpp"
+
+/**
+ * Result of compactConstantPool()
+ */
+struct CompactionStats {
+    /// Number of entries merged into an equal entry
+    ui2 merged;
+    /// Number of entries dropped as nothing referred to them
+    ui2 dropped;
+};
+
+/**
+ * Compacts the constant pool of a module in place. Equal entries are merged into the first
+ * of them and entries nothing refers to are dropped. Every reference to the pool is then
+ * rewritten, in the header, globals, classes, fields, methods, args, locals, exception tables,
+ * match cases and the operands of instructions that take from the constant pool.
+ * Entries keep their relative order, so no entry moves to a higher index and operands
+ * one byte wide still fit.
+ * The code arrays are modified in place, so in Mode::MAPPED they must come from a
+ * reader whose mapping is still open
+ * @param elp the module
+ * @return how many entries were removed
+ * @throws std::out_of_range if a reference lies outside the constant pool
+ * @throws errors::BytecodeError if an instruction cannot be decoded
+ */
+CompactionStats compactConstantPool(ElpInfo &elp);
+
+#endif    // ELPOPS_COMPACT_HPP
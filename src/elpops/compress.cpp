@@ -0,0 +1,126 @@
+#include "compress.hpp"
+#include "../spimp/lz.hpp"
+#include "../spimp/parallel.hpp"
+#include "writer.hpp"
+#include <algorithm>
+
+/// Size of the magic, version and frame count
+static constexpr size_t HEADER_SIZE = 12;
+/// Size of an entry of the frame table
+static constexpr size_t FRAME_ENTRY_SIZE = 8;
+
+CompressedElp::CompressedElp(std::span<const std::byte> data, string name) : data(data), name(name) {
+    auto bytes = reinterpret_cast<const uint8 *>(data.data());
+    if (!isCompressed(data) || data.size() < HEADER_SIZE || loadBigEndian<ui4>(bytes + 4) != ELP_COMPRESSED_VERSION) {
+        throw errors::CorruptFileError(name);
+    }
+    uint64 count = loadBigEndian<ui4>(bytes + 8);
+    uint64 dataOffset = HEADER_SIZE + count * FRAME_ENTRY_SIZE;
+    if (dataOffset > data.size()) throw errors::CorruptFileError(name);
+    frames.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint8 *entry = bytes + HEADER_SIZE + i * FRAME_ENTRY_SIZE;
+        Frame &frame = frames[i];
+        frame.offset = size;
+        frame.length = loadBigEndian<ui4>(entry);
+        frame.dataOffset = dataOffset;
+        frame.storedLength = loadBigEndian<ui4>(entry + 4);
+        if (frame.storedLength > frame.length) throw errors::CorruptFileError(name);
+        // Every byte of a block expands to at most 255 bytes, so a larger length is corrupt and must not be allocated
+        if (frame.storedLength != frame.length && frame.length > uint64(frame.storedLength) * 255 + 16) {
+            throw errors::CorruptFileError(name);
+        }
+        size += frame.length;
+        dataOffset += frame.storedLength;
+    }
+    if (dataOffset != data.size()) throw errors::CorruptFileError(name);
+}
+
+bool CompressedElp::isCompressed(std::span<const std::byte> data) {
+    return data.size() >= 4 && loadBigEndian<ui4>(reinterpret_cast<const uint8 *>(data.data())) == ELP_COMPRESSED_MAGIC;
+}
+
+size_t CompressedElp::findFrame(uint64 offset) const {
+    if (offset >= size) throw std::out_of_range(format("offset %llu past the end of the module", (unsigned long long) offset));
+    auto it = std::upper_bound(frames.begin(), frames.end(), offset,
+                               [](uint64 offset, const Frame &frame) { return offset < frame.offset; });
+    // Empty frames share their offset with the next one, upper_bound skips past them
+    return it - frames.begin() - 1;
+}
+
+void CompressedElp::decompressFrame(size_t index, std::span<std::byte> dest) const {
+    const Frame &frame = frames.at(index);
+    if (dest.size() < frame.length) throw std::length_error("decompressFrame(): buffer too small for frame");
+    auto src = reinterpret_cast<const uint8 *>(data.data()) + frame.dataOffset;
+    auto out = reinterpret_cast<uint8 *>(dest.data());
+    if (frame.storedLength == frame.length) {
+        memcpy(out, src, frame.length);
+    } else if (!lzDecompress(src, frame.storedLength, out, frame.length)) {
+        throw errors::CorruptFileError(name);
+    }
+}
+
+vector<std::byte> CompressedElp::decompress(size_t threads) const {
+    vector<std::byte> output(size);
+    parallelFor(frames.size(), threads, [&](size_t i, size_t) {
+        decompressFrame(i, std::span(output).subspan(frames[i].offset, frames[i].length));
+    });
+    return output;
+}
+
+vector<std::byte> compressElp(const ElpInfo &elp, size_t threads, bool tableOfContents) {
+    auto module = encodeParallel(elp, threads, tableOfContents);
+
+    // Frames end where the head ends, after every group of objects reaching
+    // FRAME_SIZE bytes, after the last object and at the end of the module
+    SizeSink headSink;
+    ElpEncoder<SizeSink>{headSink}.writeHead(elp);
+    vector<size_t> sizes(elp.objectsCount);
+    parallelFor(elp.objectsCount, threads, [&](size_t i, size_t) {
+        SizeSink sink;
+        ElpEncoder<SizeSink> encoder{sink};
+        encoder.setVarint((elp.minorVersion & ELP_MINOR_VARINT) != 0);
+        encoder.writeObject(elp.objects[i]);
+        sizes[i] = sink.getPosition();
+    });
+    vector<size_t> bounds{0, headSink.getPosition()};
+    size_t position = bounds.back();
+    for (size_t size: sizes) {
+        position += size;
+        if (position - bounds.back() >= CompressedElp::FRAME_SIZE) bounds.push_back(position);
+    }
+    if (position != bounds.back()) bounds.push_back(position);
+    bounds.push_back(module.size());
+
+    size_t count = bounds.size() - 1;
+    vector<vector<uint8>> stored(count);
+    parallelFor(count, threads, [&](size_t i, size_t) {
+        auto src = reinterpret_cast<const uint8 *>(module.data()) + bounds[i];
+        size_t length = bounds[i + 1] - bounds[i];
+        if (length > UINT32_MAX) throw std::length_error("compressElp(): frame exceeds 4 GiB");
+        stored[i].resize(lzBound(length));
+        size_t storedLength = lzCompress(src, length, stored[i].data());
+        if (storedLength < length) {
+            stored[i].resize(storedLength);
+        } else {
+            stored[i].assign(src, src + length);
+        }
+    });
+
+    size_t total = HEADER_SIZE + count * FRAME_ENTRY_SIZE;
+    for (auto &frame: stored) total += frame.size();
+    vector<std::byte> output(total);
+    auto out = reinterpret_cast<uint8 *>(output.data());
+    storeBigEndian<ui4>(out, ELP_COMPRESSED_MAGIC);
+    storeBigEndian<ui4>(out + 4, ELP_COMPRESSED_VERSION);
+    storeBigEndian<ui4>(out + 8, static_cast<ui4>(count));
+    size_t dataOffset = HEADER_SIZE + count * FRAME_ENTRY_SIZE;
+    for (size_t i = 0; i < count; ++i) {
+        uint8 *entry = out + HEADER_SIZE + i * FRAME_ENTRY_SIZE;
+        storeBigEndian<ui4>(entry, static_cast<ui4>(bounds[i + 1] - bounds[i]));
+        storeBigEndian<ui4>(entry + 4, static_cast<ui4>(stored[i].size()));
+        memcpy(out + dataOffset, stored[i].data(), stored[i].size());
+        dataOffset += stored[i].size();
+    }
+    return output;
+}
@@ -0,0 +1,109 @@
+#ifndef ELPOPS_COMPRESS_HPP
+#define ELPOPS_COMPRESS_HPP
+
+#include "elpdef.hpp"
+#include <span>
+
+/**
+ * A compressed ELP file. The encoded module is cut into frames along its sections,
+ * one for everything in front of the objects, then the objects in groups of about
+ * FRAME_SIZE bytes, then the meta and table of contents. Each frame is compressed
+ * on its own with lzCompress(), so frames can be decompressed independently and in parallel.
+ * ElpReader recognizes compressed files and decompresses them up front.
+ * <br>
+ * Layout, all integers big endian :-
+ * <pre>
+ * ui4 magic                                   (ELP_COMPRESSED_MAGIC)
+ * ui4 version                                 (ELP_COMPRESSED_VERSION)
+ * ui4 frameCount
+ * frame frames[frameCount]                    (each ui4 length, ui4 storedLength)
+ * ui1 data[]                                  (the frames one after another)
+ * </pre>
+ * length is the size of the frame decompressed, a frame whose storedLength equals
+ * its length was incompressible and is stored as it is
+ */
+class CompressedElp {
+  public:
+    struct Frame {
+        /// Offset of the frame in the decompressed module
+        uint64 offset;
+        ui4 length;
+        /// Offset of the stored bytes in the compressed file
+        uint64 dataOffset;
+        ui4 storedLength;
+    };
+
+    /// Size the objects are grouped into frames by
+    static constexpr size_t FRAME_SIZE = 64 * 1024;
+
+  private:
+    std::span<const std::byte> data;
+    string name;
+    vector<Frame> frames;
+    uint64 size = 0;
+
+  public:
+    /**
+     * Parses the frame table of a compressed file, the buffer must outlive this object
+     * @param data the compressed file
+     * @param name the name used in error messages
+     * @throws errors::CorruptFileError if the frame table is invalid
+     */
+    explicit CompressedElp(std::span<const std::byte> data, string name = "<memory>");
+
+    /**
+     * @return whether the buffer starts like a compressed file
+     */
+    static bool isCompressed(std::span<const std::byte> data);
+
+    /**
+     * @return the size of the decompressed module
+     */
+    uint64 getSize() const { return size; }
+
+    const vector<Frame> &getFrames() const { return frames; }
+
+    /**
+     * Finds the frame holding a byte of the decompressed module, for example the
+     * start of an object given by the table of contents
+     * @param offset offset in the decompressed module
+     * @return index of the frame
+     * @throws std::out_of_range if offset lies past the end of the module
+     */
+    size_t findFrame(uint64 offset) const;
+
+    /**
+     * Decompresses a single frame
+     * @param index index of the frame
+     * @param dest the output, at least as long as the frame
+     * @throws std::length_error if dest is too small
+     * @throws errors::CorruptFileError if the frame is corrupt
+     */
+    void decompressFrame(size_t index, std::span<std::byte> dest) const;
+
+    /**
+     * Decompresses every frame on a pool of worker threads
+     * @param threads number of threads, 0 for one per hardware thread
+     * @return the decompressed module
+     * @throws errors::CorruptFileError if a frame is corrupt
+     */
+    vector<std::byte> decompress(size_t threads = 0) const;
+};
+
+/// Marks the start of a compressed ELP file
+constexpr ui4 ELP_COMPRESSED_MAGIC = 0x454C505A;    // 'ELPZ'
+
+/// The compressed file version written by compressElp()
+constexpr ui4 ELP_COMPRESSED_VERSION = 1;
+
+/**
+ * Encodes a module like encode() and compresses it into the layout described by
+ * CompressedElp. The frames are compressed on a pool of worker threads
+ * @param elp the module
+ * @param threads number of threads, 0 for one per hardware thread
+ * @param tableOfContents whether a table of contents is included
+ * @return the compressed file
+ */
+vector<std::byte> compressElp(const ElpInfo &elp, size_t threads = 0, bool tableOfContents = false);
+
+#endif    // ELPOPS_COMPRESS_HPP
@@ -0,0 +1,49 @@
+#include "decoded.hpp"
+#include "../spimp/exceptions.hpp"
+#include "../spinfo/bytecode.hpp"
+#include <algorithm>
+
+DecodedMethod::DecodedMethod(const MethodInfo &method, const ElpInfo &elp) {
+    // Most instructions take one param or none, so this is rarely more than one growth off
+    instructions.reserve(method.codeCount / 2 + 1);
+    pcs.reserve(method.codeCount / 2 + 2);
+    for (const Instruction &instruction: Bytecode(method.code, method.codeCount)) {
+        DecodedInstruction decoded{};
+        decoded.opcode = instruction.opcode;
+        decoded.operand = instruction.operand;
+        if (instruction.isConstPoolRef) {
+            if (instruction.operand >= elp.constantPoolCount) {
+                throw std::out_of_range(format("constant pool index %u out of range", instruction.operand));
+            }
+            decoded.constant = &elp.constantPool[instruction.operand];
+        } else if (instruction.opcode == Opcode::CLOSURELOAD) {
+            decoded.closureParams = closureParams.size();
+            for (size_t i = 0; i < instruction.operand; ++i) closureParams.push_back(instruction.getClosureParam(i));
+        } else if (OpcodeInfo::isJump(instruction.opcode)) {
+            // Resolved to an index once the pcs of all instructions are known
+            int64 target = instruction.getJumpTarget();
+            if (target < 0 || target > method.codeCount) {
+                throw errors::BytecodeError(format("jump at %u leaves the code", instruction.pc));
+            }
+            decoded.operand = static_cast<uint32>(target);
+        }
+        instructions.push_back(decoded);
+        pcs.push_back(instruction.pc);
+    }
+    pcs.push_back(method.codeCount);
+
+    for (size_t i = 0; i < instructions.size(); ++i) {
+        DecodedInstruction &decoded = instructions[i];
+        if (!OpcodeInfo::isJump(decoded.opcode)) continue;
+        auto it = std::lower_bound(pcs.begin(), pcs.end(), decoded.operand);
+        if (*it != decoded.operand) {
+            throw errors::BytecodeError(format("jump at %u lands inside the instruction at %u", pcs[i], *(it - 1)));
+        }
+        decoded.operand = static_cast<uint32>(it - pcs.begin());
+    }
+}
+
+size_t DecodedMethod::getIndex(uint32 pc) const {
+    if (pc > pcs.back()) throw std::out_of_range(format("pc %u past the end of the code", pc));
+    return std::upper_bound(pcs.begin(), pcs.end(), pc) - pcs.begin() - 1;
+}
@@ -0,0 +1,78 @@
+#ifndef ELPOPS_DECODED_HPP
+#define ELPOPS_DECODED_HPP
+
+#include "../spinfo/opcode.hpp"
+#include "elpdef.hpp"
+
+/**
+ * An instruction of a DecodedMethod, all of them the same size so the
+ * interpreter can index and step through them without decoding anything
+ */
+struct DecodedInstruction {
+    Opcode opcode;
+    /// The param widened, the index of the target instruction for jumps, the number of params for CLOSURELOAD
+    uint32 operand;
+
+    union {
+        /// The constant the param refers to if the opcode takes from the constant pool
+        const CpInfo *constant;
+        /// Offset of the params of CLOSURELOAD in DecodedMethod::getClosureParams()
+        size_t closureParams;
+    };
+};
+
+static_assert(sizeof(DecodedInstruction) == 16, "DecodedInstruction should stay two words");
+
+/**
+ * The code of a method translated into an array of DecodedInstruction.
+ * Params are widened to native integers, constant pool references point at their CpInfo
+ * and jumps hold the index of the instruction they land on, which is the number of instructions
+ * for a jump to the end of the code. The pc of every instruction is kept, so pcs found in
+ * exception tables, line info and match tables can be mapped to instructions and back.
+ * <br>
+ * The constants are not copied, the constant pool must outlive the decoded method
+ */
+class DecodedMethod {
+  private:
+    vector<DecodedInstruction> instructions;
+    /// The pc of every instruction followed by the size of the code
+    vector<uint32> pcs;
+    vector<uint16> closureParams;
+
+  public:
+    /**
+     * Translates the code of a method
+     * @param method the method, its lambdas are left to be translated on their own
+     * @param elp the module the method belongs to
+     * @throws errors::BytecodeError if the code cannot be decoded or a jump does not land on an instruction
+     * @throws std::out_of_range if a param lies outside the constant pool
+     */
+    DecodedMethod(const MethodInfo &method, const ElpInfo &elp);
+
+    const vector<DecodedInstruction> &getInstructions() const { return instructions; }
+
+    const DecodedInstruction &operator[](size_t index) const { return instructions[index]; }
+
+    size_t size() const { return instructions.size(); }
+
+    /**
+     * @return the params of every CLOSURELOAD one after another
+     */
+    const vector<uint16> &getClosureParams() const { return closureParams; }
+
+    /**
+     * @param index index of an instruction, or the number of instructions
+     * @return the pc of the instruction, or the size of the code
+     */
+    uint32 getPc(size_t index) const { return pcs[index]; }
+
+    /**
+     * Finds the instruction a pc belongs to, for example the start of a range of the exception table
+     * @param pc a pc in the code, or the size of the code
+     * @return index of the instruction holding the pc, or the number of instructions
+     * @throws std::out_of_range if the pc lies past the end of the code
+     */
+    size_t getIndex(uint32 pc) const;
+};
+
+#endif    // ELPOPS_DECODED_HPP
@@ -0,0 +1,387 @@
+#include "disassembler.hpp"
+#include "../spimp/exceptions.hpp"
+#include "../spimp/parallel.hpp"
+#include "../spinfo/bytecode.hpp"
+#include "../spinfo/sign.hpp"
+#include <bit>
+#include <charconv>
+
+/// Rough number of output bytes the jobs of a chunk are grouped up to
+static constexpr size_t CHUNK_COST = 64 * 1024;
+/// Number of chunks rendered per worker thread before the output is handed to the sink
+static constexpr size_t CHUNKS_PER_WORKER = 4;
+/// Width the mnemonics are padded to
+static constexpr size_t MNEMONIC_WIDTH = 12;
+
+static void appendIndent(string &out, uint32 depth) {
+    out.append(2 * depth, ' ');
+}
+
+template<typename T>
+static void appendDecimal(string &out, T value) {
+    char text[32];
+    auto result = std::to_chars(text, text + sizeof(text), value);
+    out.append(text, result.ptr);
+}
+
+/**
+ * Appends value in hexadecimal, padded with zeros to width digits
+ */
+static void appendHex(string &out, uint64 value, size_t width) {
+    char text[16];
+    auto result = std::to_chars(text, text + sizeof(text), value, 16);
+    size_t length = result.ptr - text;
+    if (length < width) out.append(width - length, '0');
+    out.append(text, length);
+}
+
+static void appendEscaped(string &out, uint32 c, char quote) {
+    switch (c) {
+        case '\n':
+            out.append("\\n");
+            return;
+        case '\r':
+            out.append("\\r");
+            return;
+        case '\t':
+            out.append("\\t");
+            return;
+        case '\\':
+            out.append("\\\\");
+            return;
+        default:
+            break;
+    }
+    if (c == static_cast<uint8>(quote)) {
+        out.push_back('\\');
+        out.push_back(quote);
+    } else if (c < 0x20 || c == 0x7F) {
+        out.append("\\x");
+        appendHex(out, c, 2);
+    } else if (c < 0x80 || quote == '"') {
+        // Strings hold UTF-8, which passes through byte by byte
+        out.push_back(static_cast<char>(c));
+    } else {
+        out.append("\\u{");
+        appendHex(out, c, 0);
+        out.push_back('}');
+    }
+}
+
+static void appendLiteral(string &out, const CpInfo &constant) {
+    switch (constant.tag) {
+        case 0x03:
+            out.push_back('\'');
+            appendEscaped(out, constant._char, '\'');
+            out.push_back('\'');
+            break;
+        case 0x04:
+            appendDecimal(out, static_cast<int64>(constant._int));
+            break;
+        case 0x05: {
+            size_t start = out.size();
+            appendDecimal(out, std::bit_cast<double>(constant._float));
+            // Keep floats apart from ints, 2 is written as 2.0
+            if (out.find_first_of(".eEn", start) == string::npos) out.append(".0");
+            break;
+        }
+        case 0x06:
+            out.push_back('"');
+            for (size_t i = 0; i < constant._string.len; ++i) appendEscaped(out, constant._string.bytes[i], '"');
+            out.push_back('"');
+            break;
+        case 0x07:
+            out.push_back('[');
+            for (size_t i = 0; i < constant._array.len; ++i) {
+                if (i > 0) out.append(", ");
+                appendLiteral(out, constant._array.items[i]);
+            }
+            out.push_back(']');
+            break;
+        default:
+            throw errors::Unreachable();
+    }
+}
+
+/**
+ * @return the string as it is if it is a signature Sign gives back unchanged, otherwise the literal
+ */
+static string renderSymbol(const CpInfo &constant, const string &literal) {
+    if (constant.tag != 0x06 || constant._string.len == 0) return literal;
+    string text{reinterpret_cast<const char *>(constant._string.bytes), constant._string.len};
+    try {
+        if (Sign(text).toString() == text) return text;
+    } catch (const errors::SignatureError &) {}
+    return literal;
+}
+
+/**
+ * @return the number of bytes of code of a method and its lambdas
+ */
+static size_t codeSize(const MethodInfo &method) {
+    size_t size = method.codeCount;
+    for (size_t i = 0; i < method.lambdaCount; ++i) size += codeSize(method.lambdas[i]);
+    return size;
+}
+
+Disassembler::Disassembler(const ElpInfo &elp, size_t threads) : elp(elp) {
+    literals.resize(elp.constantPoolCount);
+    symbols.resize(elp.constantPoolCount);
+    parallelFor(elp.constantPoolCount, threads, [&](size_t i, size_t) {
+        appendLiteral(literals[i], elp.constantPool[i]);
+        symbols[i] = renderSymbol(elp.constantPool[i], literals[i]);
+    });
+
+    jobs.push_back({Job::Kind::HEAD, &elp, 0});
+    addJobs(elp.objects, elp.objectsCount, 0);
+
+    // Instructions render to roughly eight times their size
+    chunks.push_back(0);
+    size_t cost = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        cost += 64;
+        if (jobs[i].kind == Job::Kind::METHOD) cost += 8 * codeSize(*static_cast<const MethodInfo *>(jobs[i].info));
+        if (cost >= CHUNK_COST) {
+            chunks.push_back(i + 1);
+            cost = 0;
+        }
+    }
+    if (chunks.back() != jobs.size()) chunks.push_back(jobs.size());
+}
+
+void Disassembler::addJobs(const ObjInfo *objects, size_t count, uint32 depth) {
+    for (size_t i = 0; i < count; ++i) {
+        switch (objects[i].type) {
+            case 0x01:
+                jobs.push_back({Job::Kind::METHOD, &objects[i]._method, depth});
+                break;
+            case 0x02: {
+                const ClassInfo &klass = objects[i]._class;
+                jobs.push_back({Job::Kind::CLASS_BEGIN, &klass, depth});
+                for (size_t j = 0; j < klass.methodsCount; ++j) jobs.push_back({Job::Kind::METHOD, &klass.methods[j], depth + 1});
+                addJobs(klass.objects, klass.objectsCount, depth + 1);
+                jobs.push_back({Job::Kind::CLASS_END, &klass, depth});
+                break;
+            }
+            default:
+                throw errors::Unreachable();
+        }
+    }
+}
+
+void Disassembler::appendConstant(string &out, cpidx index, bool symbol) const {
+    if (index >= literals.size()) {
+        out.append("<invalid #");
+        appendDecimal(out, index);
+        out.push_back('>');
+        return;
+    }
+    out.append(symbol ? symbols[index] : literals[index]);
+}
+
+void Disassembler::renderJob(const Job &job, string &out) const {
+    switch (job.kind) {
+        case Job::Kind::HEAD:
+            renderHead(out);
+            break;
+        case Job::Kind::METHOD:
+            disassemble(*static_cast<const MethodInfo *>(job.info), out, job.depth);
+            break;
+        case Job::Kind::CLASS_BEGIN:
+            renderClass(*static_cast<const ClassInfo *>(job.info), job.depth, out);
+            break;
+        case Job::Kind::CLASS_END:
+            appendIndent(out, job.depth);
+            out.append("end\n");
+            break;
+    }
+}
+
+void Disassembler::renderHead(string &out) const {
+    out.append("module ");
+    appendConstant(out, elp.thisModule, true);
+    out.append("  ; compiled from ");
+    appendConstant(out, elp.compiledFrom, false);
+    out.append(", type ");
+    appendDecimal(out, elp.type);
+    out.push_back('\n');
+    for (size_t i = 0; i < elp.globalsCount; ++i) {
+        const GlobalInfo &global = elp.globals[i];
+        out.append("global ");
+        appendConstant(out, global.thisGlobal, true);
+        out.append(" : ");
+        appendConstant(out, global.type, true);
+        out.append("  ; flags 0x");
+        appendHex(out, global.flags, 2);
+        out.push_back('\n');
+    }
+}
+
+void Disassembler::renderClass(const ClassInfo &klass, uint32 depth, string &out) const {
+    appendIndent(out, depth);
+    out.append("class ");
+    appendConstant(out, klass.thisClass, true);
+    out.append(" : ");
+    appendConstant(out, klass.supers, false);
+    out.append("  ; type ");
+    appendDecimal(out, klass.type);
+    out.append(", flags 0x");
+    appendHex(out, klass.accessFlags, 4);
+    out.push_back('\n');
+    for (size_t i = 0; i < klass.typeParamCount; ++i) {
+        appendIndent(out, depth + 1);
+        out.append("typeparam ");
+        appendConstant(out, klass.typeParams[i].name, true);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < klass.fieldsCount; ++i) {
+        const FieldInfo &field = klass.fields[i];
+        appendIndent(out, depth + 1);
+        out.append("field ");
+        appendConstant(out, field.thisField, true);
+        out.append(" : ");
+        appendConstant(out, field.type, true);
+        out.append("  ; flags 0x");
+        appendHex(out, field.flags, 4);
+        out.push_back('\n');
+    }
+}
+
+void Disassembler::disassemble(const MethodInfo &method, string &out, uint32 depth) const {
+    appendIndent(out, depth);
+    out.append("method ");
+    appendConstant(out, method.thisMethod, true);
+    out.append("  ; type ");
+    appendDecimal(out, method.type);
+    out.append(", flags 0x");
+    appendHex(out, method.accessFlags, 4);
+    out.append(", stack ");
+    appendDecimal(out, method.maxStack);
+    out.push_back('\n');
+    for (size_t i = 0; i < method.typeParamCount; ++i) {
+        appendIndent(out, depth + 1);
+        out.append("typeparam ");
+        appendConstant(out, method.typeParams[i].name, true);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < method.argsCount; ++i) {
+        appendIndent(out, depth + 1);
+        out.append("arg ");
+        appendConstant(out, method.args[i].thisArg, true);
+        out.append(" : ");
+        appendConstant(out, method.args[i].type, true);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < method.localsCount; ++i) {
+        appendIndent(out, depth + 1);
+        out.append(i < method.closureStart ? "local " : "closure ");
+        appendConstant(out, method.locals[i].thisLocal, true);
+        out.append(" : ");
+        appendConstant(out, method.locals[i].type, true);
+        out.push_back('\n');
+    }
+
+    for (const Instruction &instruction: Bytecode(method.code, method.codeCount)) {
+        appendIndent(out, depth + 1);
+        appendHex(out, instruction.pc, 4);
+        out.append("  ");
+        std::string_view mnemonic = OpcodeInfo::toString(instruction.opcode);
+        out.append(mnemonic);
+        if (instruction.length == 1) {
+            out.push_back('\n');
+            continue;
+        }
+        out.append(mnemonic.size() < MNEMONIC_WIDTH ? MNEMONIC_WIDTH - mnemonic.size() : 1, ' ');
+        if (instruction.isConstPoolRef) {
+            out.push_back('#');
+            appendDecimal(out, instruction.operand);
+            out.push_back(' ');
+            bool value = instruction.opcode == Opcode::CONST || instruction.opcode == Opcode::CONSTL;
+            appendConstant(out, static_cast<cpidx>(instruction.operand), !value);
+        } else if (OpcodeInfo::isJump(instruction.opcode)) {
+            out.push_back(instruction.opcode == Opcode::JBW ? '-' : '+');
+            appendDecimal(out, instruction.operand);
+            out.append(" -> ");
+            int64 target = instruction.getJumpTarget();
+            if (target < 0) {
+                appendDecimal(out, target);
+            } else {
+                appendHex(out, target, 4);
+            }
+        } else if (instruction.opcode == Opcode::CLOSURELOAD) {
+            appendDecimal(out, instruction.operand);
+            for (size_t i = 0; i < instruction.operand; ++i) {
+                out.push_back(' ');
+                appendDecimal(out, instruction.getClosureParam(i));
+            }
+        } else {
+            appendDecimal(out, instruction.operand);
+        }
+        out.push_back('\n');
+    }
+
+    for (size_t i = 0; i < method.exceptionTableCount; ++i) {
+        const auto &entry = method.exceptionTable[i];
+        appendIndent(out, depth + 1);
+        out.append("catch ");
+        appendHex(out, entry.startPc, 4);
+        out.push_back(' ');
+        appendHex(out, entry.endPc, 4);
+        out.append(" -> ");
+        appendHex(out, entry.targetPc, 4);
+        out.push_back(' ');
+        appendConstant(out, entry.exception, true);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < method.lineInfo.numberCount; ++i) {
+        appendIndent(out, depth + 1);
+        out.append("line ");
+        appendDecimal(out, method.lineInfo.numbers[i].lineno);
+        out.append(" x");
+        appendDecimal(out, method.lineInfo.numbers[i].times);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < method.matchCount; ++i) {
+        const auto &match = method.matches[i];
+        appendIndent(out, depth + 1);
+        out.append("match ");
+        appendDecimal(out, i);
+        out.push_back('\n');
+        for (size_t j = 0; j < match.caseCount; ++j) {
+            appendIndent(out, depth + 2);
+            out.append("case #");
+            appendDecimal(out, match.cases[j].value);
+            out.push_back(' ');
+            appendConstant(out, match.cases[j].value, false);
+            out.append(" -> ");
+            appendHex(out, match.cases[j].location, 4);
+            out.push_back('\n');
+        }
+        appendIndent(out, depth + 2);
+        out.append("default -> ");
+        appendHex(out, match.defaultLocation, 4);
+        out.push_back('\n');
+    }
+    for (size_t i = 0; i < method.lambdaCount; ++i) disassemble(method.lambdas[i], out, depth + 1);
+    appendIndent(out, depth);
+    out.append("end\n");
+}
+
+void Disassembler::disassemble(const std::function<void(std::string_view)> &sink, size_t threads) {
+    size_t count = chunks.size() - 1;
+    size_t batch = workerCount(threads, count) * CHUNKS_PER_WORKER;
+    if (buffers.size() < std::min(batch, count)) buffers.resize(std::min(batch, count));
+    for (size_t first = 0; first < count; first += batch) {
+        size_t size = std::min(batch, count - first);
+        parallelFor(size, threads, [&](size_t i, size_t) {
+            string &out = buffers[i];
+            out.clear();
+            for (size_t job = chunks[first + i]; job < chunks[first + i + 1]; ++job) renderJob(jobs[job], out);
+        });
+        for (size_t i = 0; i < size; ++i) sink(buffers[i]);
+    }
+}
+
+void Disassembler::disassemble(string &out, size_t threads) {
+    disassemble([&](std::string_view text) { out.append(text); }, threads);
+}
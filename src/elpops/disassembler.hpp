@@ -0,0 +1,97 @@
+#ifndef ELPOPS_DISASSEMBLER_HPP
+#define ELPOPS_DISASSEMBLER_HPP
+
+#include "elpdef.hpp"
+#include <functional>
+#include <string_view>
+
+/**
+ * Renders a module as text, one instruction per line with its constant pool operand resolved.
+ * Operands of CONST and CONSTL are shown as the value of the constant, other operands taken
+ * from the constant pool as symbols, that is as the bare string when it is a signature
+ * in the form Sign gives it and quoted otherwise. Jumps show the pc they land on.
+ * <br>
+ * The module is split into its head, methods, class headers and class ends, which are rendered
+ * independently on a pool of worker threads into buffers that are reused from one call
+ * to the next, then handed out in module order. The constant pool is rendered once
+ * when the disassembler is created.
+ * <br>
+ * Output looks like :-
+ * <pre>
+ * module mod  ; compiled from "mod.sp", type 0
+ * global mod.x : mod.Int  ; flags 0x00
+ * method mod.f(mod.Int)  ; type 0, flags 0x0001, stack 2
+ *   arg a : mod.Int
+ *   0000  aload        0
+ *   0002  const        #3 42
+ *   0004  jt           +3 -> 0009
+ *   ...
+ * end
+ * </pre>
+ */
+class Disassembler {
+  private:
+    /// A piece of the module that is rendered on its own
+    struct Job {
+        enum class Kind { HEAD, METHOD, CLASS_BEGIN, CLASS_END } kind;
+        const void *info;
+        uint32 depth;
+    };
+
+    const ElpInfo &elp;
+    /// Every constant rendered as a value
+    vector<string> literals;
+    /// Every constant rendered as a symbol
+    vector<string> symbols;
+    vector<Job> jobs;
+    /// Number of jobs in front of each chunk, the last element being the number of jobs
+    vector<size_t> chunks;
+    /// Output of each chunk in flight, kept around so their capacity is reused
+    vector<string> buffers;
+
+    void addJobs(const ObjInfo *objects, size_t count, uint32 depth);
+
+    void renderJob(const Job &job, string &out) const;
+
+    void renderHead(string &out) const;
+
+    void renderClass(const ClassInfo &klass, uint32 depth, string &out) const;
+
+    void appendConstant(string &out, cpidx index, bool symbol) const;
+
+  public:
+    /**
+     * Renders the constant pool and splits the module into jobs, the module must outlive this object
+     * @param elp the module
+     * @param threads number of threads to render the constant pool on, 0 for one per hardware thread
+     */
+    explicit Disassembler(const ElpInfo &elp, size_t threads = 0);
+
+    /**
+     * Appends a method and its lambdas
+     * @param method the method, from the module of this disassembler
+     * @param out the output
+     * @param depth the nesting level, indented by two spaces each
+     * @throws errors::BytecodeError if the code cannot be decoded
+     */
+    void disassemble(const MethodInfo &method, string &out, uint32 depth = 0) const;
+
+    /**
+     * Renders the whole module in batches, a few chunks per worker thread at a time.
+     * sink receives the text in module order on the calling thread, once a batch is done
+     * @param sink receives the text piece by piece, the views are only valid during the call
+     * @param threads number of threads, 0 for one per hardware thread
+     * @throws errors::BytecodeError if the code of a method cannot be decoded
+     */
+    void disassemble(const std::function<void(std::string_view)> &sink, size_t threads = 0);
+
+    /**
+     * Appends the whole module
+     * @param out the output
+     * @param threads number of threads, 0 for one per hardware thread
+     * @throws errors::BytecodeError if the code of a method cannot be decoded
+     */
+    void disassemble(string &out, size_t threads = 0);
+};
+
+#endif    // ELPOPS_DISASSEMBLER_HPP
@@ -210,4 +210,57 @@ struct ElpInfo {
     MetaInfo meta;
 };
 
+/**
+ * Set in ElpInfo::minorVersion of modules written in the varint variant of the format.
+ * From compiledFrom onwards, every index into the constant pool, every count and length,
+ * closureStart, maxStack, codeCount and match locations are unsigned LEB128 integers
+ * of at most 32 bits instead of big endian ui2 or ui4. Line numbers and exception table
+ * pcs are zigzag LEB128 deltas, from the previous lineno, the startPc of the previous entry,
+ * the startPc and the endPc for lineno, startPc, endPc and targetPc respectively.
+ * Single bytes, flags, constant values and the table of contents are unchanged.
+ * Modules are encoded in it when their minorVersion has this bit set, and ElpReader
+ * detects it from the minorVersion of the file
+ */
+constexpr ui4 ELP_MINOR_VARINT = 0x80000000;
+
+/**
+ * Table of contents that can be appended to an ELP file after the module meta.
+ * It gives the location of every top level section and object, so they can be
+ * reached without decoding everything in front of them. Readers that do not know
+ * about it stop after the meta and never see it.
+ * <br>
+ * Layout, all integers big endian :-
+ * <pre>
+ * ui4 version
+ * section constantPool, globals, objects, meta     (each ui4 offset, ui4 length)
+ * ui2 objectsCount
+ * section objects[objectsCount]
+ * ui4 tocOffset                                     (offset of version)
+ * ui4 magic                                         (ELP_TOC_MAGIC)
+ * </pre>
+ * A section starts at its count field, an object starts at its type byte
+ */
+struct TocInfo {
+    struct Section {
+        ui4 offset;
+        ui4 length;
+    };
+
+    ui4 version;
+    Section constantPool;
+    Section globals;
+    Section objects;
+    Section meta;
+    vector<Section> objectSections;
+};
+
+/// Marks the end of an ELP file with a table of contents
+constexpr ui4 ELP_TOC_MAGIC = 0x544F4331;    // 'TOC1'
+
+/// The table of contents version written by ElpWriter
+constexpr ui4 ELP_TOC_VERSION = 1;
+
+/// Size of the trailer following the table of contents
+constexpr ui4 ELP_TOC_TRAILER_SIZE = 8;
+
 #endif /* LOADER_ELPDEF_HPP_ */
@@ -0,0 +1,435 @@
+#ifndef ELPOPS_ENCODER_HPP
+#define ELPOPS_ENCODER_HPP
+
+#include "../spimp/exceptions.hpp"
+#include "../spimp/utils.hpp"
+#include "elpdef.hpp"
+
+/**
+ * Walks an ElpInfo tree in the order of the ELP format and hands its contents
+ * to a sink. ElpWriter, serializedSize() and encode() all share this walk and
+ * differ only in their sink. A sink provides
+ * <pre>
+ * template&lt;typename T&gt; void writeBigEndian(T value)     stores an integer
+ * void writeBytes(const uint8 *bytes, size_t count)          stores bytes as they are
+ * size_t getPosition() const                                 number of bytes stored so far
+ * </pre>
+ * A module can also be written piece by piece, with its objects encoded
+ * separately, as long as the pieces end up back to back in module order
+ */
+template<typename Sink>
+class ElpEncoder {
+  private:
+    Sink &sink;
+    /// Position of the module being written, table of contents offsets are relative to it
+    size_t moduleStart = 0;
+    bool tableOfContents;
+    /// The table of contents of the module being written
+    TocInfo toc;
+    /// Offset of the objects count of the module being written
+    size_t objectsStart = 0;
+    /// Whether indices and lengths are LEB128 encoded, see ELP_MINOR_VARINT
+    bool varint = false;
+
+    void write(uint8 i) { sink.writeBigEndian(i); }
+
+    void write(uint16 i) { sink.writeBigEndian(i); }
+
+    void write(uint32 i) { sink.writeBigEndian(i); }
+
+    void write(uint64 i) { sink.writeBigEndian(i); }
+
+    /**
+     * Writes an index, count or length, LEB128 encoded in the varint variant and as it is otherwise
+     */
+    template<typename T>
+    void writeCompact(T value) {
+        if (varint) {
+            writeVarint(value);
+        } else {
+            write(value);
+        }
+    }
+
+    /**
+     * Writes a line number or pc, as a zigzag LEB128 delta from previous in the varint variant
+     */
+    void writeDelta(uint32 value, uint32 previous) {
+        if (varint) {
+            auto delta = static_cast<int32>(value - previous);
+            writeVarint(static_cast<uint32>(delta) << 1 ^ static_cast<uint32>(delta >> 31));
+        } else {
+            write(value);
+        }
+    }
+
+    void writeVarint(uint32 value) {
+        uint8 bytes[5];
+        size_t count = 0;
+        for (; value >= 0x80; value >>= 7) bytes[count++] = static_cast<uint8>(value | 0x80);
+        bytes[count++] = static_cast<uint8>(value);
+        sink.writeBytes(bytes, count);
+    }
+
+    /**
+     * @return the section from start up to the current position, relative to the module
+     */
+    TocInfo::Section section(size_t start) const {
+        return {static_cast<ui4>(start), static_cast<ui4>(sink.getPosition() - moduleStart - start)};
+    }
+
+    void write(const TocInfo &toc) {
+        auto tocOffset = static_cast<ui4>(sink.getPosition() - moduleStart);
+        write(toc.version);
+        write(toc.constantPool);
+        write(toc.globals);
+        write(toc.objects);
+        write(toc.meta);
+        write(static_cast<ui2>(toc.objectSections.size()));
+        for (auto section: toc.objectSections) {
+            write(section);
+        }
+        write(tocOffset);
+        write(ELP_TOC_MAGIC);
+    }
+
+    void write(TocInfo::Section section) {
+        write(section.offset);
+        write(section.length);
+    }
+
+    void write(const CpInfo &info) {
+        write(info.tag);
+        switch (info.tag) {
+            case 0x03:
+                write(info._char);
+                break;
+            case 0x04:
+                write(info._int);
+                break;
+            case 0x05:
+                write(info._float);
+                break;
+            case 0x06:
+                write(info._string);
+                break;
+            case 0x07:
+                write(info._array);
+                break;
+            default:
+                throw errors::Unreachable();
+        }
+    }
+
+    void write(const __UTF8 &utf) {
+        writeCompact(utf.len);
+        sink.writeBytes(utf.bytes, utf.len);
+    }
+
+    void write(const __Container &con) {
+        writeCompact(con.len);
+        for (int i = 0; i < con.len; ++i) {
+            write(con.items[i]);
+        }
+    }
+
+    void write(const GlobalInfo &info) {
+        write(info.flags);
+        writeCompact(info.thisGlobal);
+        writeCompact(info.type);
+        write(info.meta);
+    }
+
+    void write(const ObjInfo &info) {
+        write(info.type);
+        switch (info.type) {
+            case 0x01:
+                write(info._method);
+                break;
+            case 0x02:
+                write(info._class);
+                break;
+            default:
+                throw errors::Unreachable();
+        }
+    }
+
+    void write(const MethodInfo &info) {
+        write(info.accessFlags);
+        write(info.type);
+        writeCompact(info.thisMethod);
+        write(info.typeParamCount);
+        for (int i = 0; i < info.typeParamCount; ++i) {
+            write(info.typeParams[i]);
+        }
+        write(info.argsCount);
+        for (int i = 0; i < info.argsCount; ++i) {
+            write(info.args[i]);
+        }
+        writeCompact(info.localsCount);
+        writeCompact(info.closureStart);
+        for (int i = 0; i < info.localsCount; ++i) {
+            write(info.locals[i]);
+        }
+        writeCompact(info.maxStack);
+        writeCompact(info.codeCount);
+        sink.writeBytes(info.code, info.codeCount);
+        writeCompact(info.exceptionTableCount);
+        for (int i = 0; i < info.exceptionTableCount; ++i) {
+            write(info.exceptionTable[i], i > 0 ? info.exceptionTable[i - 1].startPc : 0);
+        }
+        write(info.lineInfo);
+        writeCompact(info.lambdaCount);
+        for (int i = 0; i < info.lambdaCount; ++i) {
+            write(info.lambdas[i]);
+        }
+        writeCompact(info.matchCount);
+        for (int i = 0; i < info.matchCount; ++i) {
+            write(info.matches[i]);
+        }
+        write(info.meta);
+    }
+
+    void write(const MethodInfo::LineInfo &line) {
+        writeCompact(line.numberCount);
+        for (int i = 0; i < line.numberCount; ++i) {
+            auto &info = line.numbers[i];
+            write(info.times);
+            writeDelta(info.lineno, i > 0 ? line.numbers[i - 1].lineno : 0);
+        }
+    }
+
+    void write(const MethodInfo::ArgInfo &info) {
+        writeCompact(info.thisArg);
+        writeCompact(info.type);
+        write(info.meta);
+    }
+
+    void write(const MethodInfo::LocalInfo &info) {
+        writeCompact(info.thisLocal);
+        writeCompact(info.type);
+        write(info.meta);
+    }
+
+    void write(const MethodInfo::ExceptionTableInfo &info, ui4 previousStartPc) {
+        writeDelta(info.startPc, previousStartPc);
+        writeDelta(info.endPc, info.startPc);
+        writeDelta(info.targetPc, info.endPc);
+        writeCompact(info.exception);
+        write(info.meta);
+    }
+
+    void write(const MethodInfo::MatchInfo &info) {
+        writeCompact(info.caseCount);
+        for (int i = 0; i < info.caseCount; ++i) {
+            write(info.cases[i]);
+        }
+        writeCompact(info.defaultLocation);
+        write(info.meta);
+    }
+
+    void write(const MethodInfo::MatchInfo::CaseInfo &info) {
+        writeCompact(info.value);
+        writeCompact(info.location);
+    }
+
+    void write(const ClassInfo &info) {
+        write(info.type);
+        write(info.accessFlags);
+        writeCompact(info.thisClass);
+        write(info.typeParamCount);
+        for (int i = 0; i < info.typeParamCount; ++i) {
+            write(info.typeParams[i]);
+        }
+        writeCompact(info.supers);
+        writeCompact(info.fieldsCount);
+        for (int i = 0; i < info.fieldsCount; ++i) {
+            write(info.fields[i]);
+        }
+        writeCompact(info.methodsCount);
+        for (int i = 0; i < info.methodsCount; ++i) {
+            write(info.methods[i]);
+        }
+        writeCompact(info.objectsCount);
+        for (int i = 0; i < info.objectsCount; ++i) {
+            write(info.objects[i]);
+        }
+        write(info.meta);
+    }
+
+    void write(const FieldInfo &info) {
+        write(info.flags);
+        writeCompact(info.thisField);
+        writeCompact(info.type);
+        write(info.meta);
+    }
+
+    void write(const TypeParamInfo &info) {
+        writeCompact(info.name);
+    }
+
+    void write(const MetaInfo &info) {
+        writeCompact(info.len);
+        for (int i = 0; i < info.len; ++i) {
+            auto &meta = info.table[i];
+            write(meta.key);
+            write(meta.value);
+        }
+    }
+
+  public:
+    /**
+     * @param sink the sink
+     * @param tableOfContents whether a table of contents (see TocInfo) is appended to modules
+     */
+    explicit ElpEncoder(Sink &sink, bool tableOfContents = false) : sink(sink), tableOfContents(tableOfContents) {}
+
+    /**
+     * Writes a module, that is writeHead(), every object and writeTail()
+     * @param elp the module
+     */
+    void write(const ElpInfo &elp) {
+        writeHead(elp);
+        for (int i = 0; i < elp.objectsCount; ++i) {
+            writeObject(elp.objects[i]);
+        }
+        writeTail(elp);
+    }
+
+    /**
+     * Writes the part of a module in front of its objects, up to and including the objects count
+     * @param elp the module
+     */
+    void writeHead(const ElpInfo &elp) {
+        moduleStart = sink.getPosition();
+        write(elp.magic);
+        write(elp.minorVersion);
+        write(elp.majorVersion);
+        varint = (elp.minorVersion & ELP_MINOR_VARINT) != 0;
+        writeCompact(elp.compiledFrom);
+        write(elp.type);
+        writeCompact(elp.thisModule);
+        writeCompact(elp.init);
+        writeCompact(elp.entry);
+        writeCompact(elp.imports);
+        toc = {};
+        toc.version = ELP_TOC_VERSION;
+        size_t start = sink.getPosition() - moduleStart;
+        writeCompact(elp.constantPoolCount);
+        for (int i = 0; i < elp.constantPoolCount; ++i) {
+            write(elp.constantPool[i]);
+        }
+        toc.constantPool = section(start);
+        start = sink.getPosition() - moduleStart;
+        writeCompact(elp.globalsCount);
+        for (int i = 0; i < elp.globalsCount; ++i) {
+            write(elp.globals[i]);
+        }
+        toc.globals = section(start);
+        objectsStart = sink.getPosition() - moduleStart;
+        writeCompact(elp.objectsCount);
+    }
+
+    /**
+     * Writes the next top level object of the module
+     */
+    void writeObject(const ObjInfo &obj) {
+        size_t start = sink.getPosition() - moduleStart;
+        write(obj);
+        if (tableOfContents) toc.objectSections.push_back(section(start));
+    }
+
+    /**
+     * Accounts for the next top level object of the module when it was
+     * encoded elsewhere. The sink must provide skip(size_t count)
+     * @param size size of the object in bytes
+     */
+    void skipObject(size_t size) {
+        size_t start = sink.getPosition() - moduleStart;
+        sink.skip(size);
+        if (tableOfContents) toc.objectSections.push_back(section(start));
+    }
+
+    /**
+     * Sets whether objects and methods written on their own, without writeHead(), are
+     * encoded in the varint variant (see ELP_MINOR_VARINT). writeHead() sets it from the module
+     */
+    void setVarint(bool enabled) { varint = enabled; }
+
+    /**
+     * Writes a method on its own, as it appears among the methods of a class
+     */
+    void writeMethod(const MethodInfo &method) { write(method); }
+
+    /**
+     * Writes a table of contents on its own
+     * @param toc the table of contents
+     * @param offset the offset of the table of contents in its module
+     */
+    void writeToc(const TocInfo &toc, size_t offset) {
+        moduleStart = sink.getPosition() - offset;
+        write(toc);
+    }
+
+    /**
+     * Writes the part of a module after its objects, that is the meta
+     * and the table of contents
+     * @param elp the module
+     */
+    void writeTail(const ElpInfo &elp) {
+        toc.objects = section(objectsStart);
+        size_t start = sink.getPosition() - moduleStart;
+        write(elp.meta);
+        toc.meta = section(start);
+        if (tableOfContents) write(toc);
+    }
+};
+
+/**
+ * Sink that only counts the bytes it is given
+ */
+class SizeSink {
+  private:
+    size_t position = 0;
+
+  public:
+    template<typename T>
+    void writeBigEndian(T) {
+        position += sizeof(T);
+    }
+
+    void writeBytes(const uint8 *, size_t count) { position += count; }
+
+    void skip(size_t count) { position += count; }
+
+    size_t getPosition() const { return position; }
+};
+
+/**
+ * Sink that stores into memory known to be large enough, without any checks
+ */
+class BufferSink {
+  private:
+    uint8 *start;
+    uint8 *cur;
+
+  public:
+    explicit BufferSink(uint8 *dest) : start(dest), cur(dest) {}
+
+    template<typename T>
+    void writeBigEndian(T value) {
+        storeBigEndian(cur, value);
+        cur += sizeof(T);
+    }
+
+    void writeBytes(const uint8 *bytes, size_t count) {
+        if (count > 0) memcpy(cur, bytes, count);
+        cur += count;
+    }
+
+    void skip(size_t count) { cur += count; }
+
+    size_t getPosition() const { return cur - start; }
+};
+
+#endif    // ELPOPS_ENCODER_HPP
@@ -0,0 +1,209 @@
+#include "flat.hpp"
+#include "../spimp/exceptions.hpp"
+#include <unordered_map>
+
+/**
+ * Fills a FlatElp from an ElpInfo tree. The ranges of a node are reserved
+ * before its members are built, as building a member may append to the
+ * same array, and the members are stored into their slots afterwards
+ */
+class FlatBuilder {
+  private:
+    FlatElp &flat;
+    /// Strings added so far, viewing the bytes of the source tree
+    std::unordered_map<std::string_view, ui4> stringIndices;
+
+    template<typename T>
+    static FlatElp::Range<T> reserve(vector<T> &table, size_t count) {
+        size_t start = table.size();
+        if (start + count > UINT32_MAX) throw std::length_error("flat ELP table exceeds 2^32 entries");
+        table.resize(start + count);
+        return {static_cast<ui4>(start), static_cast<ui4>(count)};
+    }
+
+    ui4 add(const __UTF8 &utf8) {
+        std::string_view str{reinterpret_cast<const char *>(utf8.bytes), utf8.len};
+        auto [it, added] = stringIndices.try_emplace(str, flat.strings.size());
+        if (added) {
+            auto range = reserve(flat.stringBytes, utf8.len);
+            std::copy(str.begin(), str.end(), flat.stringBytes.begin() + range.start);
+            flat.strings.push_back(range);
+        }
+        return it->second;
+    }
+
+    FlatElp::Range<FlatElp::Meta> add(const MetaInfo &meta) {
+        auto range = reserve(flat.metas, meta.len);
+        for (int i = 0; i < meta.len; ++i) {
+            ui4 key = add(meta.table[i].key);
+            ui4 value = add(meta.table[i].value);
+            flat.metas[range.start + i] = {key, value};
+        }
+        return range;
+    }
+
+    void addConstants(const CpInfo *items, size_t count, size_t start) {
+        for (size_t i = 0; i < count; ++i) {
+            const CpInfo &cp = items[i];
+            ui8 value;
+            switch (cp.tag) {
+                case 0x03:
+                    value = cp._char;
+                    break;
+                case 0x04:
+                    value = cp._int;
+                    break;
+                case 0x05:
+                    value = cp._float;
+                    break;
+                case 0x06:
+                    value = add(cp._string);
+                    break;
+                case 0x07: {
+                    auto range = reserveConstants(cp._array.len);
+                    addConstants(cp._array.items, cp._array.len, range.start);
+                    value = static_cast<ui8>(range.start) << 32 | range.count;
+                    break;
+                }
+                default:
+                    throw errors::Unreachable();
+            }
+            flat.constantTags[start + i] = cp.tag;
+            flat.constantValues[start + i] = value;
+        }
+    }
+
+    FlatElp::Range<ui8> reserveConstants(size_t count) {
+        reserve(flat.constantTags, count);
+        return reserve(flat.constantValues, count);
+    }
+
+    template<typename T>
+    FlatElp::Range<T> copy(vector<T> &table, const T *items, size_t count) {
+        auto range = reserve(table, count);
+        std::copy(items, items + count, table.begin() + range.start);
+        return range;
+    }
+
+    FlatElp::Range<FlatElp::Method> add(const MethodInfo *methods, size_t count) {
+        auto range = reserve(flat.methods, count);
+        for (size_t i = 0; i < count; ++i) {
+            FlatElp::Method method = build(methods[i]);
+            flat.methods[range.start + i] = method;
+        }
+        return range;
+    }
+
+    FlatElp::Method build(const MethodInfo &info) {
+        FlatElp::Method method{};
+        method.accessFlags = info.accessFlags;
+        method.type = info.type;
+        method.thisMethod = info.thisMethod;
+        method.closureStart = info.closureStart;
+        method.maxStack = info.maxStack;
+        method.typeParams = copy(flat.typeParams, info.typeParams, info.typeParamCount);
+        method.args = reserve(flat.args, info.argsCount);
+        for (int i = 0; i < info.argsCount; ++i) {
+            auto meta = add(info.args[i].meta);
+            flat.args[method.args.start + i] = {info.args[i].thisArg, info.args[i].type, meta};
+        }
+        method.locals = reserve(flat.locals, info.localsCount);
+        for (int i = 0; i < info.localsCount; ++i) {
+            auto meta = add(info.locals[i].meta);
+            flat.locals[method.locals.start + i] = {info.locals[i].thisLocal, info.locals[i].type, meta};
+        }
+        method.code = copy(flat.code, info.code, info.codeCount);
+        method.exceptionTable = reserve(flat.exceptions, info.exceptionTableCount);
+        for (int i = 0; i < info.exceptionTableCount; ++i) {
+            auto &exception = info.exceptionTable[i];
+            auto meta = add(exception.meta);
+            flat.exceptions[method.exceptionTable.start + i] = {exception.startPc, exception.endPc, exception.targetPc,
+                                                                exception.exception, meta};
+        }
+        method.lineNumbers = copy(flat.lineNumbers, info.lineInfo.numbers, info.lineInfo.numberCount);
+        method.lambdas = add(info.lambdas, info.lambdaCount);
+        method.matches = reserve(flat.matches, info.matchCount);
+        for (int i = 0; i < info.matchCount; ++i) {
+            auto &match = info.matches[i];
+            auto cases = copy(flat.cases, match.cases, match.caseCount);
+            auto meta = add(match.meta);
+            flat.matches[method.matches.start + i] = {cases, match.defaultLocation, meta};
+        }
+        method.meta = add(info.meta);
+        return method;
+    }
+
+    FlatElp::Class build(const ClassInfo &info) {
+        FlatElp::Class klass{};
+        klass.type = info.type;
+        klass.accessFlags = info.accessFlags;
+        klass.thisClass = info.thisClass;
+        klass.supers = info.supers;
+        klass.typeParams = copy(flat.typeParams, info.typeParams, info.typeParamCount);
+        klass.fields = reserve(flat.fields, info.fieldsCount);
+        for (int i = 0; i < info.fieldsCount; ++i) {
+            auto &field = info.fields[i];
+            auto meta = add(field.meta);
+            flat.fields[klass.fields.start + i] = {field.flags, field.thisField, field.type, meta};
+        }
+        klass.methods = add(info.methods, info.methodsCount);
+        klass.objects = add(info.objects, info.objectsCount);
+        klass.meta = add(info.meta);
+        return klass;
+    }
+
+    FlatElp::Range<FlatElp::Obj> add(const ObjInfo *objects, size_t count) {
+        auto range = reserve(flat.objects, count);
+        for (size_t i = 0; i < count; ++i) {
+            FlatElp::Obj obj{objects[i].type, 0};
+            switch (objects[i].type) {
+                case 0x01:
+                    obj.index = add(&objects[i]._method, 1).start;
+                    break;
+                case 0x02: {
+                    auto klass = reserve(flat.classes, 1);
+                    FlatElp::Class built = build(objects[i]._class);
+                    flat.classes[klass.start] = built;
+                    obj.index = klass.start;
+                    break;
+                }
+                default:
+                    throw errors::Unreachable();
+            }
+            flat.objects[range.start + i] = obj;
+        }
+        return range;
+    }
+
+  public:
+    explicit FlatBuilder(FlatElp &flat) : flat(flat) {}
+
+    void build(const ElpInfo &elp) {
+        auto &header = flat.header;
+        header.magic = elp.magic;
+        header.minorVersion = elp.minorVersion;
+        header.majorVersion = elp.majorVersion;
+        header.compiledFrom = elp.compiledFrom;
+        header.type = elp.type;
+        header.thisModule = elp.thisModule;
+        header.init = elp.init;
+        header.entry = elp.entry;
+        header.imports = elp.imports;
+        header.constantPoolCount = elp.constantPoolCount;
+        reserveConstants(elp.constantPoolCount);
+        addConstants(elp.constantPool, elp.constantPoolCount, 0);
+        header.globals = reserve(flat.globals, elp.globalsCount);
+        for (int i = 0; i < elp.globalsCount; ++i) {
+            auto &global = elp.globals[i];
+            auto meta = add(global.meta);
+            flat.globals[header.globals.start + i] = {global.flags, global.thisGlobal, global.type, meta};
+        }
+        header.objects = add(elp.objects, elp.objectsCount);
+        header.meta = add(elp.meta);
+    }
+};
+
+FlatElp::FlatElp(const ElpInfo &elp) {
+    FlatBuilder builder{*this};
+    builder.build(elp);
+}
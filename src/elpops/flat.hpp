@@ -0,0 +1,247 @@
+#ifndef ELPOPS_FLAT_HPP
+#define ELPOPS_FLAT_HPP
+
+#include "elpdef.hpp"
+#include <span>
+#include <string_view>
+#include <type_traits>
+
+/**
+ * A flat representation of an ElpInfo tree.
+ * Every kind of entity lives in a single contiguous array shared by the whole
+ * module: all methods, all locals, all code bytes, all meta entries and so on.
+ * Entities refer to each other by 32-bit indices into these arrays instead of
+ * pointers, and the members of a node are a contiguous range of its array.
+ * Passes that visit every method or every instruction of a module walk
+ * these arrays from start to end instead of chasing pointers.
+ * <br>
+ * Constants are split into an array of tags and an array of 8 byte values.
+ * A string constant holds the index of its string, and an array constant holds
+ * the range of its items packed as start << 32 | count. The top level constant
+ * pool takes the first constantPoolCount constants, the items of array constants
+ * follow it. Strings are deduplicated
+ */
+class FlatElp {
+  public:
+    /**
+     * Refers to count entities of type T starting at index start
+     */
+    template<typename T>
+    struct Range {
+        ui4 start;
+        ui4 count;
+    };
+
+    struct Meta {
+        ui4 key;
+        ui4 value;
+    };
+
+    struct Global {
+        ui1 flags;
+        cpidx thisGlobal;
+        cpidx type;
+        Range<Meta> meta;
+    };
+
+    struct Field {
+        ui2 flags;
+        cpidx thisField;
+        cpidx type;
+        Range<Meta> meta;
+    };
+
+    struct Arg {
+        cpidx thisArg;
+        cpidx type;
+        Range<Meta> meta;
+    };
+
+    struct Local {
+        cpidx thisLocal;
+        cpidx type;
+        Range<Meta> meta;
+    };
+
+    struct Exception {
+        ui4 startPc;
+        ui4 endPc;
+        ui4 targetPc;
+        cpidx exception;
+        Range<Meta> meta;
+    };
+
+    using LineNumber = MethodInfo::LineInfo::NumberInfo;
+
+    using Case = MethodInfo::MatchInfo::CaseInfo;
+
+    struct Match {
+        Range<Case> cases;
+        ui4 defaultLocation;
+        Range<Meta> meta;
+    };
+
+    struct Method {
+        ui2 accessFlags;
+        ui1 type;
+        cpidx thisMethod;
+        ui2 closureStart;
+        ui4 maxStack;
+        Range<TypeParamInfo> typeParams;
+        Range<Arg> args;
+        Range<Local> locals;
+        Range<ui1> code;
+        Range<Exception> exceptionTable;
+        Range<LineNumber> lineNumbers;
+        Range<Method> lambdas;
+        Range<Match> matches;
+        Range<Meta> meta;
+    };
+
+    /**
+     * A top level or nested object, index refers to the methods or
+     * the classes depending on type
+     */
+    struct Obj {
+        ui1 type;
+        ui4 index;
+    };
+
+    struct Class {
+        ui1 type;
+        ui2 accessFlags;
+        cpidx thisClass;
+        cpidx supers;
+        Range<TypeParamInfo> typeParams;
+        Range<Field> fields;
+        Range<Method> methods;
+        Range<Obj> objects;
+        Range<Meta> meta;
+    };
+
+    struct Header {
+        ui4 magic;
+        ui4 minorVersion;
+        ui4 majorVersion;
+        cpidx compiledFrom;
+        ui1 type;
+        cpidx thisModule;
+        cpidx init;
+        cpidx entry;
+        cpidx imports;
+        ui2 constantPoolCount;
+        Range<Global> globals;
+        Range<Obj> objects;
+        Range<Meta> meta;
+    };
+
+  private:
+    friend class FlatBuilder;
+
+    Header header{};
+    vector<ui1> constantTags;
+    vector<ui8> constantValues;
+    /// The bytes of every string back to back
+    vector<char> stringBytes;
+    vector<Range<char>> strings;
+    vector<Meta> metas;
+    vector<Global> globals;
+    vector<Field> fields;
+    vector<TypeParamInfo> typeParams;
+    vector<Arg> args;
+    vector<Local> locals;
+    vector<ui1> code;
+    vector<Exception> exceptions;
+    vector<LineNumber> lineNumbers;
+    vector<Case> cases;
+    vector<Match> matches;
+    vector<Method> methods;
+    vector<Class> classes;
+    vector<Obj> objects;
+
+    template<typename T>
+    const vector<T> &table() const {
+        if constexpr (std::is_same_v<T, Meta>) return metas;
+        else if constexpr (std::is_same_v<T, Global>) return globals;
+        else if constexpr (std::is_same_v<T, Field>) return fields;
+        else if constexpr (std::is_same_v<T, TypeParamInfo>) return typeParams;
+        else if constexpr (std::is_same_v<T, Arg>) return args;
+        else if constexpr (std::is_same_v<T, Local>) return locals;
+        else if constexpr (std::is_same_v<T, ui1>) return code;
+        else if constexpr (std::is_same_v<T, Exception>) return exceptions;
+        else if constexpr (std::is_same_v<T, LineNumber>) return lineNumbers;
+        else if constexpr (std::is_same_v<T, Case>) return cases;
+        else if constexpr (std::is_same_v<T, Match>) return matches;
+        else if constexpr (std::is_same_v<T, Method>) return methods;
+        else if constexpr (std::is_same_v<T, Class>) return classes;
+        else {
+            static_assert(std::is_same_v<T, Obj>);
+            return objects;
+        }
+    }
+
+  public:
+    FlatElp() = default;
+
+    /**
+     * Builds the flat representation of a module
+     * @param elp the module
+     */
+    explicit FlatElp(const ElpInfo &elp);
+
+    const Header &getHeader() const { return header; }
+
+    /**
+     * @return the entities a range refers to
+     */
+    template<typename T>
+    std::span<const T> get(Range<T> range) const {
+        return {table<T>().data() + range.start, range.count};
+    }
+
+    std::span<const Global> getGlobals() const { return get(header.globals); }
+
+    std::span<const Obj> getObjects() const { return get(header.objects); }
+
+    std::span<const Meta> getMeta() const { return get(header.meta); }
+
+    /// Every method of the module, including class methods and lambdas
+    std::span<const Method> getMethods() const { return methods; }
+
+    /// Every class of the module, including nested classes
+    std::span<const Class> getClasses() const { return classes; }
+
+    /// The code of every method back to back
+    std::span<const ui1> getCode() const { return code; }
+
+    /// The tag of every constant, the first constantPoolCount make up the constant pool
+    std::span<const ui1> getConstantTags() const { return constantTags; }
+
+    /// The value of every constant, see the class description for its meaning
+    std::span<const ui8> getConstantValues() const { return constantValues; }
+
+    size_t getStringCount() const { return strings.size(); }
+
+    std::string_view getString(ui4 index) const {
+        return {stringBytes.data() + strings[index].start, strings[index].count};
+    }
+
+    /**
+     * @return the string of the string constant at index
+     */
+    std::string_view getConstantString(ui4 index) const { return getString(constantValues[index]); }
+
+    /**
+     * @return the indices of the constants that are the items of the array constant at index
+     */
+    Range<CpInfo> getConstantItems(ui4 index) const {
+        ui8 value = constantValues[index];
+        return {static_cast<ui4>(value >> 32), static_cast<ui4>(value)};
+    }
+
+    const Method &getMethod(const Obj &obj) const { return methods[obj.index]; }
+
+    const Class &getClass(const Obj &obj) const { return classes[obj.index]; }
+};
+
+#endif    // ELPOPS_FLAT_HPP
@@ -0,0 +1,317 @@
+#include "image.hpp"
+#include "reader.hpp"
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Lays out an ElpInfo tree as an image. Records are first built on the
+ * stack and then copied into the space reserved for them, as reserving
+ * space for their children may move the output buffer. Records have no
+ * padding, so the copies never carry indeterminate bytes into the image
+ */
+class ImageBuilder {
+  private:
+    vector<std::byte> output;
+
+    /**
+     * Reserves zeroed space for count records of T, aligned to 8 bytes
+     */
+    template<typename T>
+    ImageArray<T> reserve(size_t count) {
+        static_assert(std::has_unique_object_representations_v<T> && alignof(T) <= 8);
+        size_t offset = (output.size() + 7) & ~size_t(7);
+        size_t end = offset + count * sizeof(T);
+        if (end > UINT32_MAX) throw std::length_error("ELP image exceeds 4 GiB");
+        output.resize(end);
+        return {static_cast<ui4>(offset), static_cast<ui4>(count)};
+    }
+
+    template<typename T>
+    void put(const ImageArray<T> &array, size_t index, const T &record) {
+        std::memcpy(output.data() + array.offset + index * sizeof(T), &record, sizeof(T));
+    }
+
+    /**
+     * Copies count records that have the same layout in ElpInfo and in images
+     */
+    template<typename T>
+    ImageArray<T> copy(const T *items, size_t count) {
+        auto array = reserve<T>(count);
+        if (count > 0) std::memcpy(output.data() + array.offset, items, count * sizeof(T));
+        return array;
+    }
+
+    ImageUTF8 add(const __UTF8 &utf8) {
+        size_t offset = output.size();
+        if (offset + utf8.len > UINT32_MAX) throw std::length_error("ELP image exceeds 4 GiB");
+        output.resize(offset + utf8.len);
+        if (utf8.len > 0) std::memcpy(output.data() + offset, utf8.bytes, utf8.len);
+        return {static_cast<ui4>(offset), utf8.len};
+    }
+
+    ImageArray<ImageMeta> add(const MetaInfo &meta) {
+        auto array = reserve<ImageMeta>(meta.len);
+        for (int i = 0; i < meta.len; ++i) {
+            ImageMeta record{};
+            record.key = add(meta.table[i].key);
+            record.value = add(meta.table[i].value);
+            put(array, i, record);
+        }
+        return array;
+    }
+
+    ImageArray<ImageCp> add(const CpInfo *items, size_t count) {
+        auto array = reserve<ImageCp>(count);
+        for (size_t i = 0; i < count; ++i) {
+            const CpInfo &cp = items[i];
+            ImageCp record{};
+            record.tag = cp.tag;
+            switch (cp.tag) {
+                case 0x03:
+                    record._char = cp._char;
+                    break;
+                case 0x04:
+                    record._int = cp._int;
+                    break;
+                case 0x05:
+                    record._float = cp._float;
+                    break;
+                case 0x06:
+                    record._string = add(cp._string);
+                    break;
+                case 0x07:
+                    record._array = add(cp._array.items, cp._array.len);
+                    break;
+                default:
+                    throw errors::Unreachable();
+            }
+            put(array, i, record);
+        }
+        return array;
+    }
+
+    ImageArray<ImageMethod> add(const MethodInfo *methods, size_t count) {
+        auto array = reserve<ImageMethod>(count);
+        for (size_t i = 0; i < count; ++i) {
+            put(array, i, build(methods[i]));
+        }
+        return array;
+    }
+
+    ImageMethod build(const MethodInfo &method) {
+        ImageMethod record{};
+        record.accessFlags = method.accessFlags;
+        record.type = method.type;
+        record.thisMethod = method.thisMethod;
+        record.typeParams = copy(method.typeParams, method.typeParamCount);
+
+        record.args = reserve<ImageMethod::Arg>(method.argsCount);
+        for (int i = 0; i < method.argsCount; ++i) {
+            ImageMethod::Arg arg{};
+            arg.thisArg = method.args[i].thisArg;
+            arg.type = method.args[i].type;
+            arg.meta = add(method.args[i].meta);
+            put(record.args, i, arg);
+        }
+
+        record.closureStart = method.closureStart;
+        record.locals = reserve<ImageMethod::Local>(method.localsCount);
+        for (int i = 0; i < method.localsCount; ++i) {
+            ImageMethod::Local local{};
+            local.thisLocal = method.locals[i].thisLocal;
+            local.type = method.locals[i].type;
+            local.meta = add(method.locals[i].meta);
+            put(record.locals, i, local);
+        }
+
+        record.maxStack = method.maxStack;
+        record.code = copy(method.code, method.codeCount);
+
+        record.exceptionTable = reserve<ImageMethod::ExceptionTable>(method.exceptionTableCount);
+        for (int i = 0; i < method.exceptionTableCount; ++i) {
+            auto &info = method.exceptionTable[i];
+            ImageMethod::ExceptionTable exception{};
+            exception.startPc = info.startPc;
+            exception.endPc = info.endPc;
+            exception.targetPc = info.targetPc;
+            exception.exception = info.exception;
+            exception.meta = add(info.meta);
+            put(record.exceptionTable, i, exception);
+        }
+
+        record.lineNumbers = reserve<ImageMethod::LineNumber>(method.lineInfo.numberCount);
+        for (int i = 0; i < method.lineInfo.numberCount; ++i) {
+            ImageMethod::LineNumber number{};
+            number.times = method.lineInfo.numbers[i].times;
+            number.lineno = method.lineInfo.numbers[i].lineno;
+            put(record.lineNumbers, i, number);
+        }
+
+        record.lambdas = add(method.lambdas, method.lambdaCount);
+
+        record.matches = reserve<ImageMethod::Match>(method.matchCount);
+        for (int i = 0; i < method.matchCount; ++i) {
+            auto &info = method.matches[i];
+            ImageMethod::Match match{};
+            match.cases = reserve<ImageMethod::Case>(info.caseCount);
+            for (int j = 0; j < info.caseCount; ++j) {
+                ImageMethod::Case kase{};
+                kase.value = info.cases[j].value;
+                kase.location = info.cases[j].location;
+                put(match.cases, j, kase);
+            }
+            match.defaultLocation = info.defaultLocation;
+            match.meta = add(info.meta);
+            put(record.matches, i, match);
+        }
+
+        record.meta = add(method.meta);
+        return record;
+    }
+
+    ImageClass build(const ClassInfo &klass) {
+        ImageClass record{};
+        record.type = klass.type;
+        record.accessFlags = klass.accessFlags;
+        record.thisClass = klass.thisClass;
+        record.typeParams = copy(klass.typeParams, klass.typeParamCount);
+        record.supers = klass.supers;
+        record.fields = reserve<ImageField>(klass.fieldsCount);
+        for (int i = 0; i < klass.fieldsCount; ++i) {
+            ImageField field{};
+            field.flags = klass.fields[i].flags;
+            field.thisField = klass.fields[i].thisField;
+            field.type = klass.fields[i].type;
+            field.meta = add(klass.fields[i].meta);
+            put(record.fields, i, field);
+        }
+        record.methods = add(klass.methods, klass.methodsCount);
+        record.objects = add(klass.objects, klass.objectsCount);
+        record.meta = add(klass.meta);
+        return record;
+    }
+
+    ImageArray<ImageObj> add(const ObjInfo *objects, size_t count) {
+        auto array = reserve<ImageObj>(count);
+        for (size_t i = 0; i < count; ++i) {
+            ImageObj record{};
+            record.type = objects[i].type;
+            switch (objects[i].type) {
+                case 0x01: {
+                    auto method = reserve<ImageMethod>(1);
+                    put(method, 0, build(objects[i]._method));
+                    record.offset = method.offset;
+                    break;
+                }
+                case 0x02: {
+                    auto klass = reserve<ImageClass>(1);
+                    put(klass, 0, build(objects[i]._class));
+                    record.offset = klass.offset;
+                    break;
+                }
+                default:
+                    throw errors::Unreachable();
+            }
+            put(array, i, record);
+        }
+        return array;
+    }
+
+  public:
+    vector<std::byte> build(const ElpInfo &elp) {
+        auto header = reserve<ImageHeader>(1);
+        ImageHeader record{};
+        record.imageMagic = ELP_IMAGE_MAGIC;
+        record.byteOrder = ELP_IMAGE_BYTE_ORDER;
+        record.imageVersion = ELP_IMAGE_VERSION;
+        record.magic = elp.magic;
+        record.minorVersion = elp.minorVersion;
+        record.majorVersion = elp.majorVersion;
+        record.compiledFrom = elp.compiledFrom;
+        record.type = elp.type;
+        record.thisModule = elp.thisModule;
+        record.init = elp.init;
+        record.entry = elp.entry;
+        record.imports = elp.imports;
+        record.constantPool = add(elp.constantPool, elp.constantPoolCount);
+        record.globals = reserve<ImageGlobal>(elp.globalsCount);
+        for (int i = 0; i < elp.globalsCount; ++i) {
+            ImageGlobal global{};
+            global.flags = elp.globals[i].flags;
+            global.thisGlobal = elp.globals[i].thisGlobal;
+            global.type = elp.globals[i].type;
+            global.meta = add(elp.globals[i].meta);
+            put(record.globals, i, global);
+        }
+        record.objects = add(elp.objects, elp.objectsCount);
+        record.meta = add(elp.meta);
+        // Pad the end so the size is a multiple of the alignment of every record
+        output.resize((output.size() + 7) & ~size_t(7));
+        record.size = output.size();
+        put(header, 0, record);
+        return std::move(output);
+    }
+};
+
+ElpImage::ElpImage(string path) : path(path) {
+    map = std::make_shared<FileMap>(path);
+    data = map->getData();
+    size = map->getSize();
+    checkHeader();
+}
+
+ElpImage::ElpImage(std::span<const std::byte> data, string name) : path(name) {
+    if (reinterpret_cast<uintptr_t>(data.data()) % 8 != 0) {
+        owned.assign(data.begin(), data.end());
+        this->data = reinterpret_cast<const uint8 *>(owned.data());
+    } else {
+        this->data = reinterpret_cast<const uint8 *>(data.data());
+    }
+    size = data.size();
+    checkHeader();
+}
+
+ElpImage::ElpImage(vector<std::byte> data, string name) : owned(std::move(data)), path(name) {
+    this->data = reinterpret_cast<const uint8 *>(owned.data());
+    size = owned.size();
+    checkHeader();
+}
+
+void ElpImage::checkHeader() {
+    if (size < sizeof(ImageHeader)) corruptFileError();
+    auto &header = getHeader();
+    if (header.imageMagic != ELP_IMAGE_MAGIC || header.byteOrder != ELP_IMAGE_BYTE_ORDER) corruptFileError();
+    if (header.imageVersion != ELP_IMAGE_VERSION || header.size != size) corruptFileError();
+}
+
+const ImageMethod &ElpImage::getMethod(const ImageObj &obj) const {
+    if (obj.type != 0x01) corruptFileError();
+    return *at<ImageMethod>(obj.offset, 1);
+}
+
+const ImageClass &ElpImage::getClass(const ImageObj &obj) const {
+    if (obj.type != 0x02) corruptFileError();
+    return *at<ImageClass>(obj.offset, 1);
+}
+
+std::string_view ElpImage::getString(cpidx index) const {
+    auto pool = getConstantPool();
+    if (index >= pool.size() || pool[index].tag != 0x06) return {};
+    return get(pool[index]._string);
+}
+
+vector<std::byte> buildImage(const ElpInfo &elp) {
+    ImageBuilder builder;
+    return builder.build(elp);
+}
+
+void convertToImage(const string &elpPath, const string &imagePath) {
+    ElpReader reader(elpPath, ElpReader::Mode::MAPPED);
+    ElpModule module = reader.readModule();
+    reader.close();
+    auto image = buildImage(module.getInfo());
+    FILE *file = fopen(imagePath.c_str(), "wb");
+    if (file == null) throw errors::FileNotFoundError(imagePath);
+    size_t written = fwrite(image.data(), 1, image.size(), file);
+    if (fclose(file) != 0 || written != image.size()) throw errors::IOError(imagePath, "cannot write image");
+}
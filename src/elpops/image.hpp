@@ -0,0 +1,315 @@
+#ifndef ELPOPS_IMAGE_HPP
+#define ELPOPS_IMAGE_HPP
+
+#include "../spimp/exceptions.hpp"
+#include "../spimp/filemap.hpp"
+#include "elpdef.hpp"
+#include <memory>
+#include <span>
+#include <string_view>
+
+/**
+ * <strong>ELP IMAGES</strong>
+ * <hr>
+ * An image is a pre-decoded ELP module laid out exactly like the structures
+ * below. Every pointer of ElpInfo is replaced by an offset from the start of the
+ * image, so an image can be mapped and used in place without any parsing.
+ * Only the pages that are actually touched are ever read from disk.
+ * <br>
+ * Integers are stored in host byte order and records use the host layout, so
+ * an image is only valid on machines of the same kind as the one that built it.
+ * The header records the byte order and the version, and ElpImage refuses
+ * images it cannot use. Every array is aligned to 8 bytes, and records have
+ * explicit reserved fields instead of padding so that images are reproducible
+ */
+
+/// Marks the start of an ELP image
+constexpr ui4 ELP_IMAGE_MAGIC = 0x454C5049;    // 'ELPI'
+
+/// The image version written by buildImage()
+constexpr ui4 ELP_IMAGE_VERSION = 1;
+
+/// Written in host byte order to detect images of a different byte order
+constexpr ui4 ELP_IMAGE_BYTE_ORDER = 0x01020304;
+
+/**
+ * Refers to count records of type T stored at offset
+ */
+template<typename T>
+struct ImageArray {
+    ui4 offset;
+    ui4 count;
+};
+
+/**
+ * Refers to len bytes of a string stored at offset
+ */
+struct ImageUTF8 {
+    ui4 offset;
+    ui4 len;
+};
+
+struct ImageMeta {
+    ImageUTF8 key;
+    ImageUTF8 value;
+};
+
+struct ImageCp {
+    ui1 tag;
+    ui1 reserved[7];
+    union {
+        /// Widened so that every member fills the union
+        ui8 _char;
+        ui8 _int;
+        ui8 _float;
+        ImageUTF8 _string;
+        ImageArray<ImageCp> _array;
+    };
+};
+
+struct ImageGlobal {
+    ui1 flags;
+    ui1 reserved;
+    cpidx thisGlobal;
+    cpidx type;
+    ui2 reserved2;
+    ImageArray<ImageMeta> meta;
+};
+
+struct ImageField {
+    ui2 flags;
+    cpidx thisField;
+    cpidx type;
+    ui2 reserved;
+    ImageArray<ImageMeta> meta;
+};
+
+struct ImageMethod {
+    ui2 accessFlags;
+    ui1 type;
+    ui1 reserved;
+    cpidx thisMethod;
+    ui2 closureStart;
+    ImageArray<TypeParamInfo> typeParams;
+
+    struct Arg {
+        cpidx thisArg;
+        cpidx type;
+        ImageArray<ImageMeta> meta;
+    };
+
+    ImageArray<Arg> args;
+
+    struct Local {
+        cpidx thisLocal;
+        cpidx type;
+        ImageArray<ImageMeta> meta;
+    };
+
+    ImageArray<Local> locals;
+
+    ui4 maxStack;
+    ImageArray<ui1> code;
+
+    struct ExceptionTable {
+        ui4 startPc;
+        ui4 endPc;
+        ui4 targetPc;
+        cpidx exception;
+        ui2 reserved;
+        ImageArray<ImageMeta> meta;
+    };
+
+    ImageArray<ExceptionTable> exceptionTable;
+
+    struct LineNumber {
+        ui4 lineno;
+        ui1 times;
+        ui1 reserved[3];
+    };
+
+    ImageArray<LineNumber> lineNumbers;
+    ImageArray<ImageMethod> lambdas;
+
+    struct Case {
+        cpidx value;
+        ui2 reserved;
+        ui4 location;
+    };
+
+    struct Match {
+        ImageArray<Case> cases;
+        ui4 defaultLocation;
+        ImageArray<ImageMeta> meta;
+    };
+
+    ImageArray<Match> matches;
+    ImageArray<ImageMeta> meta;
+};
+
+/**
+ * A top level or nested object, offset refers to an ImageMethod
+ * or an ImageClass depending on type
+ */
+struct ImageObj {
+    ui1 type;
+    ui1 reserved[3];
+    ui4 offset;
+};
+
+struct ImageClass {
+    ui1 type;
+    ui1 reserved;
+    ui2 accessFlags;
+    cpidx thisClass;
+    cpidx supers;
+    ImageArray<TypeParamInfo> typeParams;
+    ImageArray<ImageField> fields;
+    ImageArray<ImageMethod> methods;
+    ImageArray<ImageObj> objects;
+    ImageArray<ImageMeta> meta;
+};
+
+/**
+ * The first record of every image
+ */
+struct ImageHeader {
+    ui4 imageMagic;
+    ui4 byteOrder;
+    ui4 imageVersion;
+    /// Size of the whole image in bytes
+    ui4 size;
+
+    ui4 magic;
+    ui4 minorVersion;
+    ui4 majorVersion;
+    cpidx compiledFrom;
+    ui1 type;
+    ui1 reserved;
+    cpidx thisModule;
+    cpidx init;
+    cpidx entry;
+    cpidx imports;
+
+    ImageArray<ImageCp> constantPool;
+    ImageArray<ImageGlobal> globals;
+    ImageArray<ImageObj> objects;
+    ImageArray<ImageMeta> meta;
+};
+
+/**
+ * Gives access to an ELP image in memory or mapped from a file.
+ * Opening an image only checks its header. Every accessor checks that the
+ * records it returns lie inside the image, so a damaged image throws
+ * errors::CorruptFileError instead of reading out of bounds
+ */
+class ElpImage {
+  private:
+    std::shared_ptr<FileMap> map;
+    /// Holds the image when it was copied to get it aligned
+    vector<std::byte> owned;
+    const uint8 *data = null;
+    size_t size = 0;
+    string path;
+
+    void checkHeader();
+
+    /**
+     * @return the record at offset after checking that count records of T fit there
+     */
+    template<typename T>
+    const T *at(ui4 offset, size_t count) const {
+        if (offset % alignof(T) != 0 || offset > size || (size - offset) / sizeof(T) < count) corruptFileError();
+        return reinterpret_cast<const T *>(data + offset);
+    }
+
+    [[noreturn]] void corruptFileError() const {
+        throw errors::CorruptFileError(path);
+    }
+
+  public:
+    /**
+     * Maps the image file at path
+     * @throws errors::CorruptFileError if the file is not an image this build can use
+     */
+    explicit ElpImage(string path);
+
+    /**
+     * Uses the image in data, which must outlive this object. The image is copied
+     * only if data is not aligned to 8 bytes
+     * @param data the image
+     * @param name the name used in error messages
+     */
+    explicit ElpImage(std::span<const std::byte> data, string name = "<memory>");
+
+    /**
+     * Takes ownership of the image in data
+     * @param data the image
+     * @param name the name used in error messages
+     */
+    explicit ElpImage(vector<std::byte> data, string name = "<memory>");
+
+    const ImageHeader &getHeader() const { return *reinterpret_cast<const ImageHeader *>(data); }
+
+    std::span<const ImageCp> getConstantPool() const { return get(getHeader().constantPool); }
+
+    std::span<const ImageGlobal> getGlobals() const { return get(getHeader().globals); }
+
+    std::span<const ImageObj> getObjects() const { return get(getHeader().objects); }
+
+    std::span<const ImageMeta> getMeta() const { return get(getHeader().meta); }
+
+    /**
+     * @return the records an array refers to
+     */
+    template<typename T>
+    std::span<const T> get(const ImageArray<T> &array) const {
+        return {at<T>(array.offset, array.count), array.count};
+    }
+
+    /**
+     * @return the bytes of a string, valid as long as the image
+     */
+    std::string_view get(const ImageUTF8 &utf8) const {
+        return {reinterpret_cast<const char *>(at<char>(utf8.offset, utf8.len)), utf8.len};
+    }
+
+    /**
+     * @return the method an object refers to
+     * @throws errors::CorruptFileError if the object is not a method
+     */
+    const ImageMethod &getMethod(const ImageObj &obj) const;
+
+    /**
+     * @return the class an object refers to
+     * @throws errors::CorruptFileError if the object is not a class
+     */
+    const ImageClass &getClass(const ImageObj &obj) const;
+
+    /**
+     * @return the string constant at index, or an empty string if it is not a string
+     */
+    std::string_view getString(cpidx index) const;
+
+    const uint8 *getData() const { return data; }
+
+    size_t getSize() const { return size; }
+
+    const string &getPath() const { return path; }
+};
+
+/**
+ * Builds an image holding the module
+ * @param elp the module
+ * @return the image
+ */
+vector<std::byte> buildImage(const ElpInfo &elp);
+
+/**
+ * Reads the ELP file at elpPath and writes it as an image to imagePath
+ * @param elpPath the path of the ELP file
+ * @param imagePath the path of the image
+ */
+void convertToImage(const string &elpPath, const string &imagePath);
+
+#endif    // ELPOPS_IMAGE_HPP
@@ -0,0 +1,65 @@
+#include "module.hpp"
+#include "reader.hpp"
+
+void ElpModule::release() {
+    arena.release();
+    workerArenas.clear();
+    map.reset();
+    memory = {};
+    decompressed.reset();
+    strings.reset();
+    info = {};
+    objectOffsets.clear();
+    lazy.reset();
+}
+
+const MethodInfo &ElpModule::loadMethod(const MethodInfo &method) {
+    if (lazy == null) return method;
+    std::lock_guard guard{lazy->lock};
+    auto it = lazy->bodies.find(&method);
+    if (it == lazy->bodies.end()) return method;
+    ElpReader reader{map, memory, path};
+    reader.arena = &arena;
+    reader.strings = strings;
+    reader.seek(it->second);
+    reader.readMethodBody(const_cast<MethodInfo &>(method));
+    lazy->bodies.erase(it);
+    return method;
+}
+
+void ElpModule::loadAll() {
+    if (lazy == null) return;
+    std::lock_guard guard{lazy->lock};
+    ElpReader reader{map, memory, path};
+    reader.arena = &arena;
+    reader.strings = strings;
+    for (auto [method, offset]: lazy->bodies) {
+        reader.seek(offset);
+        reader.readMethodBody(const_cast<MethodInfo &>(*method));
+    }
+    lazy->bodies.clear();
+}
+
+bool ElpModule::isLoaded(const MethodInfo &method) const {
+    if (lazy == null) return true;
+    std::lock_guard guard{lazy->lock};
+    return !lazy->bodies.contains(&method);
+}
+
+void ElpModule::indexMethod(MethodInfo &method, const vector<size_t> &offsets, size_t &next) {
+    lazy->bodies[&method] = offsets[next++];
+}
+
+void ElpModule::indexObject(ObjInfo &obj, const vector<size_t> &offsets, size_t &next) {
+    // Walks the tree in the same order as the reader skipped the bodies
+    if (obj.type == 0x01) {
+        indexMethod(obj._method, offsets, next);
+    } else {
+        for (int i = 0; i < obj._class.methodsCount; ++i) {
+            indexMethod(obj._class.methods[i], offsets, next);
+        }
+        for (int i = 0; i < obj._class.objectsCount; ++i) {
+            indexObject(obj._class.objects[i], offsets, next);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef ELPOPS_MODULE_HPP
+#define ELPOPS_MODULE_HPP
+
+#include "../spimp/arena.hpp"
+#include "../spimp/filemap.hpp"
+#include "../spimp/stringtable.hpp"
+#include "elpdef.hpp"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+/**
+ * Owns an ElpInfo tree together with all the memory it points to.
+ * The whole tree is allocated from a single arena, so destroying or
+ * releasing the module frees it at once.
+ * A module read with ElpReader::readLazy() only holds the headers of its
+ * methods at first, their bodies are decoded from the mapping by loadMethod()
+ */
+class ElpModule {
+    friend class ElpReader;
+
+  private:
+    struct LazyState {
+        std::mutex lock;
+        /// File offsets of the bodies that are yet to be decoded
+        std::unordered_map<const MethodInfo *, size_t> bodies;
+    };
+
+    Arena arena;
+    /// Arenas of the worker threads when the module was read in parallel
+    vector<Arena> workerArenas;
+    /// Keeps the file mapping alive when strings and code point into it
+    std::shared_ptr<FileMap> map;
+    /// The caller provided buffer a lazy module decodes from when it is not mapped
+    std::span<const std::byte> memory;
+    /// Keeps memory alive when it is the decompressed copy of a compressed file
+    std::shared_ptr<const vector<std::byte>> decompressed;
+    /// Keeps the table alive when strings were interned into it
+    std::shared_ptr<StringTable> strings;
+    string path;
+    ElpInfo info{};
+    /// File offsets of the top level objects
+    vector<size_t> objectOffsets;
+    std::unique_ptr<LazyState> lazy;
+
+    void indexMethod(MethodInfo &method, const vector<size_t> &offsets, size_t &next);
+
+    void indexObject(ObjInfo &obj, const vector<size_t> &offsets, size_t &next);
+
+  public:
+    explicit ElpModule(size_t arenaSize = 64 * 1024) : arena(arenaSize) {}
+
+    ElpModule(const ElpModule &) = delete;
+
+    ElpModule(ElpModule &&) noexcept = default;
+
+    ElpModule &operator=(const ElpModule &) = delete;
+
+    ElpModule &operator=(ElpModule &&) noexcept = default;
+
+    /**
+     * Frees the tree, the info of this module must not be used afterwards
+     */
+    void release();
+
+    /**
+     * Decodes the body of a method of this module if it is not decoded yet.
+     * This function is thread safe
+     * @param method a method of this module
+     * @return the method
+     */
+    const MethodInfo &loadMethod(const MethodInfo &method);
+
+    /**
+     * Decodes the bodies of all the methods that are not decoded yet
+     */
+    void loadAll();
+
+    /**
+     * @return whether the body of the method is decoded
+     */
+    bool isLoaded(const MethodInfo &method) const;
+
+    bool isLazy() const { return lazy != null; }
+
+    const vector<size_t> &getObjectOffsets() const { return objectOffsets; }
+
+    const string &getPath() const { return path; }
+
+    const ElpInfo &getInfo() const { return info; }
+
+    ElpInfo &getInfo() { return info; }
+
+    Arena &getArena() { return arena; }
+};
+
+#endif    // ELPOPS_MODULE_HPP
@@ -0,0 +1,126 @@
+#include "patch.hpp"
+#include "compress.hpp"
+#include "encoder.hpp"
+#include "reader.hpp"
+#include <filesystem>
+
+/**
+ * Moves and resizes a section of a table of contents after the bytes in [start, end) were replaced
+ */
+static void relink(TocInfo::Section &section, size_t start, size_t end, int64 delta) {
+    if (section.offset >= end) {
+        section.offset += delta;
+    } else if (section.offset <= start && section.offset + section.length >= end) {
+        section.length += delta;
+    }
+}
+
+/**
+ * Moves the sections of the table of contents, if any, past the bytes in [start, end)
+ * that were replaced and appends it to the tail that follows them
+ */
+static void appendToc(vector<uint8> &tail, std::optional<TocInfo> &toc, size_t start, size_t end, int64 delta) {
+    if (!toc) return;
+    for (auto *section: {&toc->constantPool, &toc->globals, &toc->objects, &toc->meta}) {
+        relink(*section, start, end, delta);
+    }
+    for (auto &section: toc->objectSections) {
+        relink(section, start, end, delta);
+    }
+    size_t tailEnd = toc->meta.offset + toc->meta.length;
+    SizeSink tocSize;
+    ElpEncoder<SizeSink>{tocSize}.writeToc(*toc, 0);
+    size_t tocStart = tail.size();
+    tail.resize(tocStart + tocSize.getPosition());
+    BufferSink tocSink{tail.data() + tocStart};
+    ElpEncoder<BufferSink>{tocSink}.writeToc(*toc, tailEnd);
+}
+
+static bool patchMethod(ElpReader &reader, const std::optional<TocInfo::Section> &location, const MethodInfo &method) {
+    std::optional<TocInfo> toc;
+    if (location) {
+        if (auto found = reader.getToc()) toc = *found;
+    }
+    string path = reader.getPath();
+    bool varint = reader.isVarint();
+    auto compressed = reader.getDecompressed();
+    reader.close();
+    if (!location) return false;
+
+    SizeSink sizeSink;
+    ElpEncoder<SizeSink> sizeEncoder{sizeSink};
+    sizeEncoder.setVarint(varint);
+    sizeEncoder.writeMethod(method);
+    vector<uint8> bytes(sizeSink.getPosition());
+    BufferSink sink{bytes.data()};
+    ElpEncoder<BufferSink> encoder{sink};
+    encoder.setVarint(varint);
+    encoder.writeMethod(method);
+
+    size_t start = location->offset;
+    size_t end = start + location->length;
+    int64 delta = static_cast<int64>(bytes.size()) - location->length;
+    if (compressed) {
+        // Offsets refer to the decompressed module, so the patch is applied to it in memory
+        // and the whole file is compressed again, with a fresh table of contents if it had one
+        auto data = compressed->begin();
+        size_t tailEnd = toc ? toc->meta.offset + toc->meta.length : compressed->size();
+        auto methodBytes = reinterpret_cast<const std::byte *>(bytes.data());
+        vector<std::byte> patched(data, data + start);
+        patched.insert(patched.end(), methodBytes, methodBytes + bytes.size());
+        patched.insert(patched.end(), data + end, data + tailEnd);
+        ElpReader patchedReader{patched, path};
+        ElpModule module = patchedReader.readModule();
+        vector<std::byte> output = compressElp(module.getInfo(), 0, toc.has_value());
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == null) throw errors::FileNotFoundError(path);
+        bool failed = fwrite(output.data(), 1, output.size(), file) != output.size();
+        failed |= fclose(file) != 0;
+        if (failed) throw errors::IOError(path, "cannot write file");
+        return true;
+    }
+
+    FILE *file = fopen(path.c_str(), "r+b");
+    if (file == null) throw errors::FileNotFoundError(path);
+    // Without a table of contents the tail runs to the end of the file, with one it
+    // stops in front of the table, which is rewritten instead
+    size_t tailEnd;
+    if (toc) {
+        tailEnd = toc->meta.offset + toc->meta.length;
+    } else {
+        fseek(file, 0, SEEK_END);
+        tailEnd = ftell(file);
+    }
+    vector<uint8> tail;
+    if (delta != 0) {
+        tail.resize(tailEnd - end);
+        fseek(file, end, SEEK_SET);
+        if (fread(tail.data(), 1, tail.size(), file) != tail.size()) {
+            fclose(file);
+            throw errors::IOError(path, "cannot read file");
+        }
+        appendToc(tail, toc, start, end, delta);
+    }
+    fseek(file, start, SEEK_SET);
+    bool failed = fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size();
+    if (!tail.empty()) failed |= fwrite(tail.data(), 1, tail.size(), file) != tail.size();
+    failed |= fclose(file) != 0;
+    if (failed) throw errors::IOError(path, "cannot write file");
+    if (delta < 0) {
+        std::error_code error;
+        size_t size = std::filesystem::file_size(path, error);
+        if (!error) std::filesystem::resize_file(path, size + delta, error);
+        if (error) throw errors::IOError(path, error.message());
+    }
+    return true;
+}
+
+bool patchMethod(const string &path, cpidx thisMethod, const MethodInfo &method) {
+    ElpReader reader{path};
+    return patchMethod(reader, reader.findMethod(thisMethod), method);
+}
+
+bool patchMethod(const string &path, const string &signature, const MethodInfo &method) {
+    ElpReader reader{path};
+    return patchMethod(reader, reader.findMethod(signature), method);
+}
@@ -0,0 +1,34 @@
+#ifndef ELPOPS_PATCH_HPP
+#define ELPOPS_PATCH_HPP
+
+#include "elpdef.hpp"
+
+/**
+ * Replaces a single method in an ELP file without rewriting the rest of it.
+ * The method is found with ElpReader::findMethod() and only the bytes after it are
+ * moved, so the cost depends on the size of the method and of what follows it, not
+ * on the size of the module. If the file has a table of contents, its sections are
+ * moved and resized to match. The replacement must refer to the constant pool of the file,
+ * and is encoded in the variant of the format the file is in (see ELP_MINOR_VARINT).
+ * A compressed file (see CompressedElp) cannot be patched in place, it is decompressed,
+ * patched in memory and written again in full with compressElp()
+ * @param path the path of the file
+ * @param thisMethod the constant the method to replace refers to as its thisMethod
+ * @param method the replacement
+ * @return whether the method was found and replaced
+ * @throws errors::IOError if the file cannot be written
+ */
+bool patchMethod(const string &path, cpidx thisMethod, const MethodInfo &method);
+
+/**
+ * Replaces a single method like patchMethod(const string &, cpidx, const MethodInfo &),
+ * finding it by its signature instead
+ * @param path the path of the file
+ * @param signature the signature of the method to replace
+ * @param method the replacement
+ * @return whether the method was found and replaced
+ * @throws errors::IOError if the file cannot be written
+ */
+bool patchMethod(const string &path, const string &signature, const MethodInfo &method);
+
+#endif    // ELPOPS_PATCH_HPP
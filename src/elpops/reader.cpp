@@ -1,50 +1,567 @@
 #include "reader.hpp"
+#include "../spimp/parallel.hpp"
+#include "compress.hpp"
+#include <algorithm>
 
-ElpReader::ElpReader(string path) : path(path) {
-    file = fopen(path.c_str(), "rb");
-    if (file == null) throw errors::FileNotFoundError(path);
+ElpReader::ElpReader(string path, Mode mode) : mode(mode), path(path) {
+    if (mode == Mode::MAPPED) {
+        map = std::make_shared<FileMap>(path);
+        fileSize = map->getSize();
+        std::span<const std::byte> data{reinterpret_cast<const std::byte *>(map->getData()), fileSize};
+        if (CompressedElp::isCompressed(data)) openCompressed(data);
+    } else {
+        file = fopen(path.c_str(), "rb");
+        if (file == null) throw errors::FileNotFoundError(path);
+        fseek(file, 0, SEEK_END);
+        fileSize = ftell(file);
+        std::byte magic[4];
+        ::rewind(file);
+        if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && CompressedElp::isCompressed(magic)) {
+            vector<std::byte> data(fileSize);
+            ::rewind(file);
+            bool failed = fread(data.data(), 1, fileSize, file) != fileSize;
+            fclose(file);
+            file = null;
+            if (failed) throw errors::IOError(path, "cannot read file");
+            openCompressed(data);
+        } else {
+            buffer.resize(BUFFER_SIZE);
+        }
+    }
+    rewind();
+    detectVarint();
+}
+
+ElpReader::ElpReader(std::span<const std::byte> data, string name)
+    : mode(Mode::MEMORY), memory(data), path(name), fileSize(data.size()) {
+    if (CompressedElp::isCompressed(data)) openCompressed(data);
+    rewind();
+    detectVarint();
+}
+
+void ElpReader::openCompressed(std::span<const std::byte> data) {
+    decompressed = std::make_shared<const vector<std::byte>>(CompressedElp(data, path).decompress());
+    // The compressed bytes are not needed anymore
+    map.reset();
+    mode = Mode::MEMORY;
+    memory = *decompressed;
+    fileSize = memory.size();
+}
+
+ElpReader::ElpReader(std::shared_ptr<FileMap> map, std::span<const std::byte> memory, string path)
+    : mode(map != null ? Mode::MAPPED : Mode::MEMORY), map(map), memory(memory), path(path),
+      fileSize(map != null ? map->getSize() : memory.size()) {
+    rewind();
+    detectVarint();
+}
+
+void ElpReader::detectVarint() {
+    if (fileSize < 12) return;
+    skip(4);    // magic
+    varint = (readInt() & ELP_MINOR_VARINT) != 0;
+    rewind();
+}
+
+ElpReader ElpReader::fork() const {
+    ElpReader reader{map, memory, path};
+    reader.decompressed = decompressed;
+    reader.strings = strings;
+    return reader;
+}
+
+ElpReader ElpReader::reopenMapped() const {
+    ElpReader reader{path, Mode::MAPPED};
+    reader.strings = strings;
+    return reader;
+}
+
+void ElpReader::close() {
+    if (mode == Mode::STREAM) {
+        fclose(file);
+    } else {
+        map.reset();
+        memory = {};
+        decompressed.reset();
+    }
+}
+
+void ElpReader::rewind() {
+    if (mode == Mode::STREAM) {
+        ::rewind(file);
+        base = cur = end = buffer.data();
+    } else {
+        // The window is never written through in Mode::MEMORY
+        base = cur = mode == Mode::MAPPED ? map->getData() : const_cast<uint8 *>(reinterpret_cast<const uint8 *>(memory.data()));
+        end = base + fileSize;
+    }
+    baseOffset = 0;
+}
+
+void ElpReader::seek(size_t offset) {
+    if (mode == Mode::STREAM) {
+        fseek(file, offset, SEEK_SET);
+        base = cur = end = buffer.data();
+        baseOffset = offset;
+    } else {
+        if (offset > fileSize) corruptFileError();
+        cur = base + offset;
+    }
+}
+
+void ElpReader::skip(size_t count) {
+    if (available() >= count) {
+        cur += count;
+        return;
+    }
+    if (mode != Mode::STREAM) corruptFileError();
+    count -= available();
+    fseek(file, count, SEEK_CUR);
+    baseOffset += end - base + count;
+    base = cur = end = buffer.data();
 }
 
-void ElpReader::close() const {
-    fclose(file);
+void ElpReader::fill(size_t count) {
+    if (mode != Mode::STREAM) corruptFileError();
+    // Move the undecoded tail to the front and refill the rest of the buffer
+    size_t remaining = available();
+    memmove(buffer.data(), cur, remaining);
+    baseOffset += cur - base;
+    base = cur = buffer.data();
+    end = cur + remaining;
+    end += fread(end, 1, buffer.size() - remaining, file);
+    if (available() < count) corruptFileError();
+}
+
+uint32 ElpReader::readVarintSlow() {
+    uint32 value = 0;
+    for (int i = 0; i < 5; ++i) {
+        uint32 byte = readByte();
+        if (i == 4 && byte > 0x0F) corruptFileError();
+        value |= (byte & 0x7F) << (7 * i);
+        if (byte < 0x80) break;
+    }
+    return value;
+}
+
+void ElpReader::readBytes(uint8 *dest, size_t count) {
+    size_t buffered = available();
+    if (buffered >= count) {
+        memcpy(dest, cur, count);
+        cur += count;
+        return;
+    }
+    if (mode != Mode::STREAM) corruptFileError();
+    memcpy(dest, cur, buffered);
+    cur += buffered;
+    dest += buffered;
+    count -= buffered;
+    if (count >= buffer.size()) {
+        // Large payloads bypass the buffer
+        if (fread(dest, 1, count, file) != count) corruptFileError();
+        baseOffset += cur - base + count;
+        base = cur = end = buffer.data();
+        return;
+    }
+    fill(count);
+    memcpy(dest, cur, count);
+    cur += count;
 }
 
 ElpInfo ElpReader::read() {
+    rewind();
     ElpInfo elp{};
-    elp.magic = readInt();
-    elp.minorVersion = readInt();
-    elp.majorVersion = readInt();
-    elp.compiledFrom = readShort();
-    elp.type = readByte();
-    elp.thisModule = readShort();
-    elp.init = readShort();
-    elp.entry = readShort();
-    elp.imports = readShort();
-    elp.constantPoolCount = readShort();
-    elp.constantPool = new CpInfo[elp.constantPoolCount];
+    readHeader(elp);
+    elp.objectsCount = readCompact<uint16>();
+    elp.objects = allocate<ObjInfo>(elp.objectsCount);
+    for (int i = 0; i < elp.objectsCount; ++i) {
+        elp.objects[i] = readObjInfo();
+    }
+    elp.meta = readMetaInfo();
+    return elp;
+}
+
+void ElpReader::readHeader(ElpInfo &elp) {
+    readFixedHeader(elp);
+    elp.constantPoolCount = readCompact<uint16>();
+    elp.constantPool = allocate<CpInfo>(elp.constantPoolCount);
     for (int i = 0; i < elp.constantPoolCount; ++i) {
         elp.constantPool[i] = readCpInfo();
     }
-    elp.globalsCount = readShort();
-    elp.globals = new GlobalInfo[elp.globalsCount];
+    elp.globalsCount = readCompact<uint16>();
+    elp.globals = allocate<GlobalInfo>(elp.globalsCount);
     for (int i = 0; i < elp.globalsCount; ++i) {
         elp.globals[i] = readGlobalInfo();
     }
-    elp.objectsCount = readShort();
-    elp.objects = new ObjInfo[elp.objectsCount];
-    for (int i = 0; i < elp.objectsCount; ++i) {
-        elp.objects[i] = readObjInfo();
+}
+
+void ElpReader::readFixedHeader(ElpInfo &elp) {
+    elp.magic = readInt();
+    elp.minorVersion = readInt();
+    elp.majorVersion = readInt();
+    varint = (elp.minorVersion & ELP_MINOR_VARINT) != 0;
+    elp.compiledFrom = readCompact<cpidx>();
+    elp.type = readByte();
+    elp.thisModule = readCompact<cpidx>();
+    elp.init = readCompact<cpidx>();
+    elp.entry = readCompact<cpidx>();
+    elp.imports = readCompact<cpidx>();
+}
+
+ElpModule ElpReader::readModule() {
+    // Start below the size of the decoded tree rather than reserving for the worst case,
+    // the arena doubles its chunks so reaching the final size takes only a few allocations
+    ElpModule module{fileSize / 2};
+    module.map = map;
+    module.strings = strings;
+    module.path = path;
+    arena = &module.arena;
+    try {
+        module.info = read();
+    } catch (...) {
+        arena = null;
+        throw;
     }
-    elp.meta = readMetaInfo();
-    // Reset the index to zero so that the file can be read again
-    index = 0;
-    return elp;
+    arena = null;
+    return module;
+}
+
+ElpModule ElpReader::readLazy() {
+    if (mode == Mode::STREAM) return reopenMapped().readLazy();
+    ElpModule module{fileSize};
+    module.map = map;
+    module.memory = memory;
+    module.decompressed = decompressed;
+    module.strings = strings;
+    module.path = path;
+    module.lazy = std::make_unique<ElpModule::LazyState>();
+    vector<size_t> bodies;
+    arena = &module.arena;
+    skippedBodies = &bodies;
+    try {
+        rewind();
+        ElpInfo &elp = module.info;
+        readHeader(elp);
+        elp.objectsCount = readCompact<uint16>();
+        elp.objects = allocate<ObjInfo>(elp.objectsCount);
+        module.objectOffsets.reserve(elp.objectsCount);
+        for (int i = 0; i < elp.objectsCount; ++i) {
+            module.objectOffsets.push_back(position());
+            elp.objects[i] = readObjInfo();
+        }
+        elp.meta = readMetaInfo();
+    } catch (...) {
+        arena = null;
+        skippedBodies = null;
+        throw;
+    }
+    arena = null;
+    skippedBodies = null;
+    size_t next = 0;
+    for (int i = 0; i < module.info.objectsCount; ++i) {
+        module.indexObject(module.info.objects[i], bodies, next);
+    }
+    return module;
+}
+
+ElpModule ElpReader::readParallel(size_t threads) {
+    if (mode == Mode::STREAM) return reopenMapped().readParallel(threads);
+    ElpModule module{fileSize};
+    module.map = map;
+    module.strings = strings;
+    module.path = path;
+    ElpInfo &elp = module.info;
+    arena = &module.arena;
+    try {
+        rewind();
+        readHeader(elp);
+        elp.objectsCount = readCompact<uint16>();
+        elp.objects = allocate<ObjInfo>(elp.objectsCount);
+        module.objectOffsets.reserve(elp.objectsCount);
+        if (auto contents = getToc(); contents != null && contents->objectSections.size() == elp.objectsCount) {
+            for (auto section: contents->objectSections) {
+                module.objectOffsets.push_back(section.offset);
+            }
+            seek(contents->meta.offset);
+        } else {
+            for (int i = 0; i < elp.objectsCount; ++i) {
+                module.objectOffsets.push_back(position());
+                skipObjInfo();
+            }
+        }
+        elp.meta = readMetaInfo();
+    } catch (...) {
+        arena = null;
+        throw;
+    }
+    arena = null;
+
+    // One reader and one arena per worker, each object is read by whichever worker picks it up.
+    // The arenas start small like the one of readModule() and grow by doubling
+    size_t workers = workerCount(threads, elp.objectsCount);
+    vector<ElpReader> readers;
+    readers.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+        module.workerArenas.emplace_back(fileSize / 2 / workers);
+        readers.push_back(fork());
+    }
+    for (size_t i = 0; i < workers; ++i) {
+        readers[i].arena = &module.workerArenas[i];
+    }
+    parallelFor(elp.objectsCount, workers, [&](size_t index, size_t worker) {
+        ElpReader &reader = readers[worker];
+        reader.seek(module.objectOffsets[index]);
+        elp.objects[index] = reader.readObjInfo();
+    });
+    return module;
+}
+
+const TocInfo *ElpReader::getToc() {
+    if (!tocLoaded) {
+        size_t saved = position();
+        try {
+            toc = readToc();
+        } catch (errors::CorruptFileError &) {
+            toc.reset();
+        }
+        seek(saved);
+        tocLoaded = true;
+    }
+    return toc ? &*toc : null;
+}
+
+std::optional<TocInfo> ElpReader::readToc() {
+    if (fileSize < ELP_TOC_TRAILER_SIZE) return std::nullopt;
+    size_t trailer = fileSize - ELP_TOC_TRAILER_SIZE;
+    seek(trailer);
+    ui4 tocOffset = readInt();
+    if (readInt() != ELP_TOC_MAGIC || tocOffset >= trailer) return std::nullopt;
+    seek(tocOffset);
+    TocInfo contents{};
+    contents.version = readInt();
+    if (contents.version != ELP_TOC_VERSION) return std::nullopt;
+    auto readSection = [this] {
+        TocInfo::Section section{};
+        section.offset = readInt();
+        section.length = readInt();
+        return section;
+    };
+    contents.constantPool = readSection();
+    contents.globals = readSection();
+    contents.objects = readSection();
+    contents.meta = readSection();
+    uint16 objectsCount = readShort();
+    contents.objectSections.reserve(objectsCount);
+    for (int i = 0; i < objectsCount; ++i) {
+        contents.objectSections.push_back(readSection());
+    }
+    // Anything else is not a table of contents that ends with the magic by chance
+    if (position() != trailer || contents.meta.offset + contents.meta.length != tocOffset) return std::nullopt;
+    return contents;
+}
+
+size_t ElpReader::findObject(size_t index) {
+    if (auto contents = getToc(); contents != null) {
+        if (index >= contents->objectSections.size()) corruptFileError();
+        return contents->objectSections[index].offset;
+    }
+    uint16 objectsCount = skipToObjects();
+    if (index >= objectsCount) corruptFileError();
+    for (size_t i = 0; i < index; ++i) {
+        skipObjInfo();
+    }
+    return position();
+}
+
+uint16 ElpReader::skipToObjects() {
+    rewind();
+    ElpInfo header{};
+    readFixedHeader(header);
+    uint16 constantPoolCount = readCompact<uint16>();
+    for (int i = 0; i < constantPoolCount; ++i) {
+        skipCpInfo();
+    }
+    uint16 globalsCount = readCompact<uint16>();
+    for (int i = 0; i < globalsCount; ++i) {
+        skip(1);    // flags
+        skipCompact<cpidx>(2);
+        skipMetaInfo();
+    }
+    return readCompact<uint16>();
+}
+
+ObjInfo ElpReader::readObject(size_t index) {
+    seek(findObject(index));
+    return readObjInfo();
+}
+
+MetaInfo ElpReader::readModuleMeta() {
+    if (auto contents = getToc(); contents != null) {
+        seek(contents->meta.offset);
+    } else {
+        uint16 objectsCount = skipToObjects();
+        for (int i = 0; i < objectsCount; ++i) {
+            skipObjInfo();
+        }
+    }
+    return readMetaInfo();
+}
+
+ElpHeader ElpReader::probe() {
+    rewind();
+    ElpInfo elp{};
+    readFixedHeader(elp);
+    ElpHeader header{};
+    header.magic = elp.magic;
+    header.minorVersion = elp.minorVersion;
+    header.majorVersion = elp.majorVersion;
+    header.type = elp.type;
+    header.thisModule = elp.thisModule;
+    header.entry = elp.entry;
+    uint16 constantPoolCount = readCompact<uint16>();
+    int last = std::max(elp.thisModule, elp.entry);
+    Arena scratch{0};
+    arena = &scratch;
+    try {
+        for (int i = 0; i < constantPoolCount && i <= last; ++i) {
+            if (i != elp.thisModule && i != elp.entry) {
+                skipCpInfo();
+                continue;
+            }
+            CpInfo cp = readCpInfo();
+            if (cp.tag != 0x06) continue;
+            string name{reinterpret_cast<const char *>(cp._string.bytes), cp._string.len};
+            if (i == elp.thisModule) header.thisModuleName = name;
+            if (i == elp.entry) header.entryName = name;
+        }
+    } catch (...) {
+        arena = null;
+        throw;
+    }
+    arena = null;
+    return header;
+}
+
+ElpHeader ElpReader::probe(const string &path) {
+    // Most headers fit in the first block, a larger prefix is read only
+    // when the constant pool in front of the needed entries is large
+    size_t blockSize = 4 * 1024;
+    vector<std::byte> block;
+    while (true) {
+        size_t fileSize = readFileHead(path, block, blockSize);
+        try {
+            return ElpReader(std::span<const std::byte>(block), path).probe();
+        } catch (errors::CorruptFileError &) {
+            if (blockSize >= fileSize) throw;
+        }
+        blockSize *= 4;
+    }
+}
+
+void ElpReader::accept(ElpVisitor &visitor) {
+    Arena scratch;
+    arena = &scratch;
+    skipMeta = !visitor.visitMeta();
+    try {
+        rewind();
+        ElpInfo header{};
+        readFixedHeader(header);
+        visitor.onHeader(header);
+        uint16 constantPoolCount = readCompact<uint16>();
+        for (int i = 0; i < constantPoolCount; ++i) {
+            auto mark = scratch.mark();
+            visitor.onConstant(i, readCpInfo());
+            scratch.rewind(mark);
+        }
+        uint16 globalsCount = readCompact<uint16>();
+        for (int i = 0; i < globalsCount; ++i) {
+            auto mark = scratch.mark();
+            visitor.onGlobal(readGlobalInfo());
+            scratch.rewind(mark);
+        }
+        uint16 objectsCount = readCompact<uint16>();
+        for (int i = 0; i < objectsCount; ++i) {
+            auto mark = scratch.mark();
+            visitObjInfo(visitor, scratch);
+            scratch.rewind(mark);
+        }
+        if (skipMeta) {
+            skipMetaInfo();
+        } else {
+            auto mark = scratch.mark();
+            visitor.onMeta(readMetaInfo());
+            scratch.rewind(mark);
+        }
+    } catch (...) {
+        arena = null;
+        skipMeta = false;
+        throw;
+    }
+    arena = null;
+    skipMeta = false;
+}
+
+void ElpReader::visitObjInfo(ElpVisitor &visitor, Arena &scratch) {
+    switch (readByte()) {
+        case 0x01:
+            visitMethodInfo(visitor, scratch);
+            break;
+        case 0x02:
+            visitClassInfo(visitor, scratch);
+            break;
+        default:
+            corruptFileError();
+    }
+}
+
+void ElpReader::visitClassInfo(ElpVisitor &visitor, Arena &scratch) {
+    auto mark = scratch.mark();
+    ClassInfo klass{};
+    readClassHeader(klass);
+    if (!visitor.onClassBegin(klass)) {
+        skipClassMembers();
+        scratch.rewind(mark);
+        return;
+    }
+    klass.fieldsCount = readCompact<uint16>();
+    for (int i = 0; i < klass.fieldsCount; ++i) {
+        auto fieldMark = scratch.mark();
+        visitor.onField(readFieldInfo());
+        scratch.rewind(fieldMark);
+    }
+    klass.methodsCount = readCompact<uint16>();
+    for (int i = 0; i < klass.methodsCount; ++i) {
+        visitMethodInfo(visitor, scratch);
+    }
+    klass.objectsCount = readCompact<uint16>();
+    for (int i = 0; i < klass.objectsCount; ++i) {
+        visitObjInfo(visitor, scratch);
+    }
+    klass.meta = readMetaInfo();
+    visitor.onClassEnd(klass);
+    scratch.rewind(mark);
+}
+
+void ElpReader::visitMethodInfo(ElpVisitor &visitor, Arena &scratch) {
+    auto mark = scratch.mark();
+    MethodInfo method{};
+    readMethodHeader(method);
+    if (visitor.onMethod(method)) {
+        readMethodBody(method);
+        visitor.onCode(method);
+    } else {
+        skipMethodBody();
+    }
+    scratch.rewind(mark);
 }
 
 MetaInfo ElpReader::readMetaInfo() {
+    if (skipMeta) {
+        skipMetaInfo();
+        return {};
+    }
     MetaInfo meta{};
-    meta.len = readShort();
-    meta.table = new MetaInfo::__meta[meta.len];
+    meta.len = readCompact<uint16>();
+    meta.table = allocate<MetaInfo::__meta>(meta.len);
     for (int i = 0; i < meta.len; ++i) {
         MetaInfo::__meta entry{};
         entry.key = readUTF8();
@@ -72,27 +589,19 @@ ObjInfo ElpReader::readObjInfo() {
 
 ClassInfo ElpReader::readClassInfo() {
     ClassInfo klass{};
-    klass.type = readByte();
-    klass.accessFlags = readShort();
-    klass.thisClass = readShort();
-    klass.typeParamCount = readByte();
-    klass.typeParams = new TypeParamInfo[klass.typeParamCount];
-    for (int i = 0; i < klass.typeParamCount; ++i) {
-        klass.typeParams[i] = readTypeParamInfo();
-    }
-    klass.supers = readShort();
-    klass.fieldsCount = readShort();
-    klass.fields = new FieldInfo[klass.fieldsCount];
+    readClassHeader(klass);
+    klass.fieldsCount = readCompact<uint16>();
+    klass.fields = allocate<FieldInfo>(klass.fieldsCount);
     for (int i = 0; i < klass.fieldsCount; ++i) {
         klass.fields[i] = readFieldInfo();
     }
-    klass.methodsCount = readShort();
-    klass.methods = new MethodInfo[klass.methodsCount];
+    klass.methodsCount = readCompact<uint16>();
+    klass.methods = allocate<MethodInfo>(klass.methodsCount);
     for (int i = 0; i < klass.methodsCount; ++i) {
         klass.methods[i] = readMethodInfo();
     }
-    klass.objectsCount = readShort();
-    klass.objects = new ObjInfo[klass.objectsCount];
+    klass.objectsCount = readCompact<uint16>();
+    klass.objects = allocate<ObjInfo>(klass.objectsCount);
     for (int i = 0; i < klass.objectsCount; ++i) {
         klass.objects[i] = readObjInfo();
     }
@@ -100,123 +609,145 @@ ClassInfo ElpReader::readClassInfo() {
     return klass;
 }
 
+void ElpReader::readClassHeader(ClassInfo &klass) {
+    klass.type = readByte();
+    klass.accessFlags = readShort();
+    klass.thisClass = readCompact<cpidx>();
+    klass.typeParamCount = readByte();
+    klass.typeParams = allocate<TypeParamInfo>(klass.typeParamCount);
+    for (int i = 0; i < klass.typeParamCount; ++i) {
+        klass.typeParams[i] = readTypeParamInfo();
+    }
+    klass.supers = readCompact<cpidx>();
+}
+
 FieldInfo ElpReader::readFieldInfo() {
     FieldInfo field{};
-    field.flags = readByte();
-    field.thisField = readShort();
-    field.type = readShort();
+    field.flags = readShort();
+    field.thisField = readCompact<cpidx>();
+    field.type = readCompact<cpidx>();
     field.meta = readMetaInfo();
     return field;
 }
 
 TypeParamInfo ElpReader::readTypeParamInfo() {
     TypeParamInfo typeparam{};
-    typeparam.name = readShort();
+    typeparam.name = readCompact<cpidx>();
     return typeparam;
 }
 
 MethodInfo ElpReader::readMethodInfo() {
     MethodInfo method{};
+    readMethodHeader(method);
+    if (skippedBodies != null) {
+        skippedBodies->push_back(position());
+        skipMethodBody();
+    } else {
+        readMethodBody(method);
+    }
+    return method;
+}
+
+void ElpReader::readMethodHeader(MethodInfo &method) {
     method.accessFlags = readShort();
     method.type = readByte();
-    method.thisMethod = readShort();
+    method.thisMethod = readCompact<cpidx>();
     method.typeParamCount = readByte();
-    method.typeParams = new TypeParamInfo[method.typeParamCount];
+    method.typeParams = allocate<TypeParamInfo>(method.typeParamCount);
     for (int i = 0; i < method.typeParamCount; ++i) {
         method.typeParams[i] = readTypeParamInfo();
     }
     method.argsCount = readByte();
-    method.args = new MethodInfo::ArgInfo[method.argsCount];
+    method.args = allocate<MethodInfo::ArgInfo>(method.argsCount);
     for (int i = 0; i < method.argsCount; i++) {
         method.args[i] = readArgInfo();
     }
-    method.localsCount = readShort();
-    method.closureStart = readShort();
-    method.locals = new MethodInfo::LocalInfo[method.localsCount];
+    method.localsCount = readCompact<uint16>();
+    method.closureStart = readCompact<uint16>();
+    method.locals = allocate<MethodInfo::LocalInfo>(method.localsCount);
     for (int i = 0; i < method.localsCount; i++) {
         method.locals[i] = readLocalInfo();
     }
-    method.maxStack = readInt();
-    method.codeCount = readInt();
-    method.code = new uint8[method.codeCount];
-    for (int i = 0; i < method.codeCount; i++) {
-        method.code[i] = readByte();
-    }
-    method.exceptionTableCount = readShort();
-    method.exceptionTable =
-            new MethodInfo::ExceptionTableInfo[method.exceptionTableCount];
+}
+
+void ElpReader::readMethodBody(MethodInfo &method) {
+    method.maxStack = readCompact<uint32>();
+    method.codeCount = readCompact<uint32>();
+    method.code = readArray(method.codeCount);
+    method.exceptionTableCount = readCompact<uint16>();
+    method.exceptionTable = allocate<MethodInfo::ExceptionTableInfo>(method.exceptionTableCount);
     for (int i = 0; i < method.exceptionTableCount; i++) {
-        method.exceptionTable[i] = readExceptionInfo();
+        method.exceptionTable[i] = readExceptionInfo(i > 0 ? method.exceptionTable[i - 1].startPc : 0);
     }
     method.lineInfo = readLineInfo();
-    method.lambdaCount = readShort();
-    method.lambdas = new MethodInfo[method.lambdaCount];
+    method.lambdaCount = readCompact<uint16>();
+    method.lambdas = allocate<MethodInfo>(method.lambdaCount);
     for (int i = 0; i < method.lambdaCount; i++) {
         method.lambdas[i] = readMethodInfo();
     }
-    method.matchCount = readShort();
-    method.matches = new MethodInfo::MatchInfo[method.matchCount];
+    method.matchCount = readCompact<uint16>();
+    method.matches = allocate<MethodInfo::MatchInfo>(method.matchCount);
     for (int i = 0; i < method.matchCount; i++) {
         method.matches[i] = readMatchInfo();
     }
     method.meta = readMetaInfo();
-    return method;
 }
 
 MethodInfo::MatchInfo ElpReader::readMatchInfo() {
     MethodInfo::MatchInfo match{};
-    match.caseCount = readShort();
-    match.cases = new MethodInfo::MatchInfo::CaseInfo[match.caseCount];
+    match.caseCount = readCompact<uint16>();
+    match.cases = allocate<MethodInfo::MatchInfo::CaseInfo>(match.caseCount);
     for (int i = 0; i < match.caseCount; i++) {
         match.cases[i] = readCaseInfo();
     }
-    match.defaultLocation = readInt();
+    match.defaultLocation = readCompact<uint32>();
     match.meta = readMetaInfo();
     return match;
 }
 
 MethodInfo::MatchInfo::CaseInfo ElpReader::readCaseInfo() {
     MethodInfo::MatchInfo::CaseInfo kase{};
-    kase.value = readShort();
-    kase.location = readInt();
+    kase.value = readCompact<cpidx>();
+    kase.location = readCompact<uint32>();
     return kase;
 }
 
 MethodInfo::LineInfo ElpReader::readLineInfo() {
     MethodInfo::LineInfo line{};
-    line.numberCount = readShort();
-    line.numbers = new MethodInfo::LineInfo::NumberInfo[line.numberCount];
+    line.numberCount = readCompact<uint16>();
+    line.numbers = allocate<MethodInfo::LineInfo::NumberInfo>(line.numberCount);
+    ui4 previous = 0;
     for (int i = 0; i < line.numberCount; ++i) {
         MethodInfo::LineInfo::NumberInfo number{};
         number.times = readByte();
-        number.lineno = readInt();
+        number.lineno = previous = readDelta(previous);
         line.numbers[i] = number;
     }
     return line;
 }
 
-MethodInfo::ExceptionTableInfo ElpReader::readExceptionInfo() {
+MethodInfo::ExceptionTableInfo ElpReader::readExceptionInfo(ui4 previousStartPc) {
     MethodInfo::ExceptionTableInfo exception{};
-    exception.startPc = readInt();
-    exception.endPc = readInt();
-    exception.targetPc = readInt();
-    exception.exception = readShort();
+    exception.startPc = readDelta(previousStartPc);
+    exception.endPc = readDelta(exception.startPc);
+    exception.targetPc = readDelta(exception.endPc);
+    exception.exception = readCompact<cpidx>();
     exception.meta = readMetaInfo();
     return exception;
 }
 
 MethodInfo::LocalInfo ElpReader::readLocalInfo() {
     MethodInfo::LocalInfo local{};
-    local.thisLocal = readShort();
-    local.type = readShort();
+    local.thisLocal = readCompact<cpidx>();
+    local.type = readCompact<cpidx>();
     local.meta = readMetaInfo();
     return local;
 }
 
 MethodInfo::ArgInfo ElpReader::readArgInfo() {
     MethodInfo::ArgInfo arg{};
-    arg.thisArg = readShort();
-    arg.type = readShort();
+    arg.thisArg = readCompact<cpidx>();
+    arg.type = readCompact<cpidx>();
     arg.meta = readMetaInfo();
     return arg;
 }
@@ -224,8 +755,8 @@ MethodInfo::ArgInfo ElpReader::readArgInfo() {
 GlobalInfo ElpReader::readGlobalInfo() {
     GlobalInfo global{};
     global.flags = readByte();
-    global.thisGlobal = readShort();
-    global.type = readShort();
+    global.thisGlobal = readCompact<cpidx>();
+    global.type = readCompact<cpidx>();
     global.meta = readMetaInfo();
     return global;
 }
@@ -257,8 +788,8 @@ CpInfo ElpReader::readCpInfo() {
 
 __Container ElpReader::readContainer() {
     __Container container{};
-    container.len = readShort();
-    container.items = new CpInfo[container.len];
+    container.len = readCompact<uint16>();
+    container.items = allocate<CpInfo>(container.len);
     for (int i = 0; i < container.len; ++i) {
         container.items[i] = readCpInfo();
     }
@@ -267,10 +798,212 @@ __Container ElpReader::readContainer() {
 
 __UTF8 ElpReader::readUTF8() {
     __UTF8 utf8{};
-    utf8.len = readShort();
-    utf8.bytes = new uint8[utf8.len];
-    for (int i = 0; i < utf8.len; ++i) {
-        utf8.bytes[i] = readByte();
+    utf8.len = readCompact<uint16>();
+    if (strings != null) {
+        if (available() < utf8.len) fill(utf8.len);
+        utf8.bytes = strings->intern(cur, utf8.len);
+        cur += utf8.len;
+        return utf8;
     }
+    utf8.bytes = readArray(utf8.len);
     return utf8;
 }
+
+void ElpReader::skipMetaInfo() {
+    uint16 len = readCompact<uint16>();
+    for (int i = 0; i < len; ++i) {
+        skipUTF8();
+        skipUTF8();
+    }
+}
+
+void ElpReader::skipObjInfo() {
+    switch (readByte()) {
+        case 0x01:
+            skipMethodInfo();
+            break;
+        case 0x02:
+            skipClassInfo();
+            break;
+        default:
+            corruptFileError();
+    }
+}
+
+void ElpReader::skipClassInfo() {
+    skip(3);    // type, accessFlags
+    skipCompact<cpidx>();    // thisClass
+    skipCompact<cpidx>(readByte());
+    skipCompact<cpidx>();    // supers
+    skipClassMembers();
+}
+
+void ElpReader::skipClassMembers() {
+    uint16 fieldsCount = readCompact<uint16>();
+    for (int i = 0; i < fieldsCount; ++i) {
+        skip(2);    // flags
+        skipCompact<cpidx>(2);
+        skipMetaInfo();
+    }
+    uint16 methodsCount = readCompact<uint16>();
+    for (int i = 0; i < methodsCount; ++i) {
+        skipMethodInfo();
+    }
+    uint16 objectsCount = readCompact<uint16>();
+    for (int i = 0; i < objectsCount; ++i) {
+        skipObjInfo();
+    }
+    skipMetaInfo();
+}
+
+void ElpReader::skipMethodInfo() {
+    skip(3);    // accessFlags, type
+    skipCompact<cpidx>();    // thisMethod
+    skipMethodMembers();
+}
+
+void ElpReader::skipMethodMembers() {
+    skipCompact<cpidx>(readByte());
+    uint8 argsCount = readByte();
+    for (int i = 0; i < argsCount; ++i) {
+        skipCompact<cpidx>(2);
+        skipMetaInfo();
+    }
+    uint16 localsCount = readCompact<uint16>();
+    skipCompact<uint16>();    // closureStart
+    for (int i = 0; i < localsCount; ++i) {
+        skipCompact<cpidx>(2);
+        skipMetaInfo();
+    }
+    skipMethodBody();
+}
+
+void ElpReader::skipMethodBody() {
+    skipCompact<uint32>();    // maxStack
+    skip(readCompact<uint32>());
+    uint16 exceptionTableCount = readCompact<uint16>();
+    for (int i = 0; i < exceptionTableCount; ++i) {
+        skipCompact<uint32>(3);    // startPc, endPc, targetPc
+        skipCompact<cpidx>();
+        skipMetaInfo();
+    }
+    uint16 numberCount = readCompact<uint16>();
+    if (varint) {
+        for (int i = 0; i < numberCount; ++i) {
+            skip(1);    // times
+            readVarint();
+        }
+    } else {
+        skip(numberCount * 5);
+    }
+    uint16 lambdaCount = readCompact<uint16>();
+    for (int i = 0; i < lambdaCount; ++i) {
+        skipMethodInfo();
+    }
+    uint16 matchCount = readCompact<uint16>();
+    for (int i = 0; i < matchCount; ++i) {
+        uint16 caseCount = readCompact<uint16>();
+        skipCompact<cpidx>(caseCount);
+        skipCompact<uint32>(caseCount);
+        skipCompact<uint32>();    // defaultLocation
+        skipMetaInfo();
+    }
+    skipMetaInfo();
+}
+
+void ElpReader::skipCpInfo() {
+    switch (readByte()) {
+        case 0x03:
+            skip(4);
+            break;
+        case 0x04:
+        case 0x05:
+            skip(8);
+            break;
+        case 0x06:
+            skipUTF8();
+            break;
+        case 0x07: {
+            uint16 len = readCompact<uint16>();
+            for (int i = 0; i < len; ++i) {
+                skipCpInfo();
+            }
+            break;
+        }
+        default:
+            corruptFileError();
+    }
+}
+
+template<typename Predicate>
+std::optional<TocInfo::Section> ElpReader::findMethodIf(Predicate matches) {
+    uint16 objectsCount = skipToObjects();
+    return findMethodIn(matches, objectsCount);
+}
+
+template<typename Predicate>
+std::optional<TocInfo::Section> ElpReader::findMethodIn(Predicate &matches, size_t objectsCount) {
+    auto checkMethod = [&]() -> std::optional<TocInfo::Section> {
+        size_t start = position();
+        skip(3);    // accessFlags, type
+        cpidx thisMethod = readCompact<cpidx>();
+        skipMethodMembers();
+        if (!matches(thisMethod)) return std::nullopt;
+        return TocInfo::Section{static_cast<ui4>(start), static_cast<ui4>(position() - start)};
+    };
+    for (size_t i = 0; i < objectsCount; ++i) {
+        switch (readByte()) {
+            case 0x01:
+                if (auto method = checkMethod()) return method;
+                break;
+            case 0x02: {
+                skip(3);    // type, accessFlags
+                skipCompact<cpidx>();    // thisClass
+                skipCompact<cpidx>(readByte());
+                skipCompact<cpidx>();    // supers
+                uint16 fieldsCount = readCompact<uint16>();
+                for (int j = 0; j < fieldsCount; ++j) {
+                    skip(2);    // flags
+                    skipCompact<cpidx>(2);
+                    skipMetaInfo();
+                }
+                uint16 methodsCount = readCompact<uint16>();
+                for (int j = 0; j < methodsCount; ++j) {
+                    if (auto method = checkMethod()) return method;
+                }
+                if (auto method = findMethodIn(matches, readCompact<uint16>())) return method;
+                skipMetaInfo();
+                break;
+            }
+            default:
+                corruptFileError();
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<TocInfo::Section> ElpReader::findMethod(cpidx thisMethod) {
+    return findMethodIf([thisMethod](cpidx index) { return index == thisMethod; });
+}
+
+std::optional<TocInfo::Section> ElpReader::findMethod(const string &signature) {
+    rewind();
+    ElpInfo header{};
+    readFixedHeader(header);
+    uint16 constantPoolCount = readCompact<uint16>();
+    // Constants are not necessarily unique, so any string equal to the signature will do
+    vector<bool> names(constantPoolCount);
+    for (int i = 0; i < constantPoolCount; ++i) {
+        if (cur == end) fill(1);
+        if (*cur != 0x06) {
+            skipCpInfo();
+            continue;
+        }
+        cur++;
+        uint16 len = readCompact<uint16>();
+        if (available() < len) fill(len);
+        names[i] = len == signature.size() && memcmp(cur, signature.data(), len) == 0;
+        cur += len;
+    }
+    return findMethodIf([&names](cpidx index) { return index < names.size() && names[index]; });
+}
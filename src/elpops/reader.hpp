@@ -2,13 +2,120 @@
 #define SOURCE_LOADER_PARSER_HPP_
 
 #include "../spimp/exceptions.hpp"
+#include "../spimp/filemap.hpp"
+#include "../spimp/stringtable.hpp"
+#include "../spimp/utils.hpp"
 #include "elpdef.hpp"
+#include "module.hpp"
+#include "visitor.hpp"
+#include <limits>
+#include <optional>
+#include <span>
+
+/**
+ * The fixed header of an ELP file together with the constants its
+ * module name and entry point refer to
+ */
+struct ElpHeader {
+    ui4 magic;
+    ui4 minorVersion;
+    ui4 majorVersion;
+    ui1 type;
+    cpidx thisModule;
+    cpidx entry;
+    /// The string constant at thisModule, empty if it is not a string
+    string thisModuleName;
+    /// The string constant at entry, empty if it is not a string
+    string entryName;
+};
 
 class ElpReader {
+    friend class ElpModule;
+
+  public:
+    /// Describes how the reader accesses the file
+    enum class Mode {
+        /// The file is read through stdio and every string and code array is copied
+        STREAM,
+        /// The file is memory mapped and strings and code arrays point into the mapping
+        MAPPED,
+        /// The file is a caller provided buffer and every string and code array is copied
+        MEMORY
+    };
+
   private:
-    uint32 index = 0;
-    FILE *file;
+    /// Size of the read buffer used in Mode::STREAM
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    Mode mode;
+    FILE *file = null;
+    std::shared_ptr<FileMap> map;
+    /// The buffer read in Mode::MEMORY
+    std::span<const std::byte> memory;
+    /// Owns the buffer read in Mode::MEMORY when the file was compressed
+    std::shared_ptr<const vector<std::byte>> decompressed;
     string path;
+    size_t fileSize = 0;
+    /// The arena the tree is allocated from, plain new[] is used if null
+    Arena *arena = null;
+    vector<uint8> buffer;
+    /// Start of the current window, either the read buffer, the mapping or the memory buffer
+    uint8 *base = null;
+    /// Next byte to be decoded
+    uint8 *cur = null;
+    /// End of the decodable bytes in the window
+    uint8 *end = null;
+    /// File offset of base
+    size_t baseOffset = 0;
+    /// Collects the offsets of skipped method bodies when reading lazily, null otherwise
+    vector<size_t> *skippedBodies = null;
+    /// Whether meta tables are skipped and read as empty tables
+    bool skipMeta = false;
+    /// Whether indices and lengths are LEB128 encoded, see ELP_MINOR_VARINT
+    bool varint = false;
+    /// The table strings are interned into, strings are allocated per tree if null
+    std::shared_ptr<StringTable> strings;
+    /// Whether the table of contents was looked for
+    bool tocLoaded = false;
+    std::optional<TocInfo> toc;
+
+    /**
+     * Creates a reader over an existing mapping if map is not null,
+     * or over memory otherwise
+     */
+    ElpReader(std::shared_ptr<FileMap> map, std::span<const std::byte> memory, string path);
+
+    /**
+     * Sets whether the file is in the varint variant of the format from its minorVersion
+     */
+    void detectVarint();
+
+    /**
+     * Decompresses a file written by compressElp() and switches to
+     * reading the decompressed module in Mode::MEMORY
+     */
+    void openCompressed(std::span<const std::byte> data);
+
+    /**
+     * @return a new reader over the same mapping or memory buffer
+     */
+    ElpReader fork() const;
+
+    /**
+     * @return a new reader over a mapping of the file of this reader
+     */
+    ElpReader reopenMapped() const;
+
+    /**
+     * Reads everything in front of the objects, that is the header,
+     * the constant pool and the globals
+     */
+    void readHeader(ElpInfo &elp);
+
+    /**
+     * Reads the fixed size part of the header, from magic to imports
+     */
+    void readFixedHeader(ElpInfo &elp);
 
     MetaInfo readMetaInfo();
 
@@ -16,15 +123,30 @@ class ElpReader {
 
     ClassInfo readClassInfo();
 
+    /**
+     * Reads the part of a class in front of its fields
+     */
+    void readClassHeader(ClassInfo &klass);
+
     FieldInfo readFieldInfo();
 
     TypeParamInfo readTypeParamInfo();
 
     MethodInfo readMethodInfo();
 
+    /**
+     * Reads the part of a method in front of its body (maxStack and onwards)
+     */
+    void readMethodHeader(MethodInfo &method);
+
+    void readMethodBody(MethodInfo &method);
+
     MethodInfo::LineInfo readLineInfo();
 
-    MethodInfo::ExceptionTableInfo readExceptionInfo();
+    /**
+     * @param previousStartPc startPc of the previous entry, which the varint variant encodes startPc from
+     */
+    MethodInfo::ExceptionTableInfo readExceptionInfo(ui4 previousStartPc);
 
     MethodInfo::LocalInfo readLocalInfo();
 
@@ -42,27 +164,184 @@ class ElpReader {
 
     __UTF8 readUTF8();
 
+    void skipMetaInfo();
+
+    void skipObjInfo();
+
+    void skipClassInfo();
+
+    /**
+     * Skips the fields, methods, objects and meta of a class
+     */
+    void skipClassMembers();
+
+    void skipMethodInfo();
+
+    /**
+     * Skips the part of a method after its thisMethod
+     */
+    void skipMethodMembers();
+
+    void skipMethodBody();
+
+    void skipCpInfo();
+
+    /**
+     * Reads the table of contents at the end of the file if there is one
+     */
+    std::optional<TocInfo> readToc();
+
+    /**
+     * @return the file offset of the top level object at index, from the
+     * table of contents if there is one and by scanning otherwise
+     */
+    size_t findObject(size_t index);
+
+    /**
+     * Skips everything in front of the first top level object
+     * @return the number of top level objects
+     */
+    uint16 skipToObjects();
+
+    void skipUTF8() { skip(readCompact<uint16>()); }
+
+    /**
+     * Finds the first method, top level or a member of a possibly nested class,
+     * whose thisMethod satisfies matches
+     */
+    template<typename Predicate>
+    std::optional<TocInfo::Section> findMethodIf(Predicate matches);
+
+    template<typename Predicate>
+    std::optional<TocInfo::Section> findMethodIn(Predicate &matches, size_t objectsCount);
+
+    void visitObjInfo(ElpVisitor &visitor, Arena &scratch);
+
+    void visitClassInfo(ElpVisitor &visitor, Arena &scratch);
+
+    void visitMethodInfo(ElpVisitor &visitor, Arena &scratch);
+
+    /**
+     * Moves the reader back to the start of the file
+     */
+    void rewind();
+
+    /**
+     * Moves the reader to the file offset
+     */
+    void seek(size_t offset);
+
+    /**
+     * @return number of bytes in the window that are not decoded yet
+     */
+    size_t available() const { return end - cur; }
+
+    /**
+     * Skips the next count bytes of the file
+     */
+    void skip(size_t count);
+
+    /**
+     * Makes sure that at least count bytes are available in the window
+     * @throws errors::CorruptFileError if the file ends before that
+     */
+    void fill(size_t count);
+
+    /**
+     * Copies the next count bytes of the file to dest
+     */
+    void readBytes(uint8 *dest, size_t count);
+
+    template<typename T>
+    T *allocate(size_t count) {
+        return arena != null ? arena->alloc<T>(count) : new T[count];
+    }
+
+    /**
+     * Allocates a buffer holding the next count bytes of the file. In Mode::MAPPED
+     * no copy is made and a pointer into the mapping is returned
+     */
+    uint8 *readArray(size_t count) {
+        if (mode == Mode::MAPPED) {
+            if (available() < count) corruptFileError();
+            uint8 *bytes = cur;
+            cur += count;
+            return bytes;
+        }
+        auto bytes = allocate<uint8>(count);
+        readBytes(bytes, count);
+        return bytes;
+    }
+
+    template<typename T>
+    T readBigEndian() {
+        if (available() < sizeof(T)) fill(sizeof(T));
+        T value = loadBigEndian<T>(cur);
+        cur += sizeof(T);
+        return value;
+    }
+
     uint8 readByte() {
-        index++;
-        return fgetc(file);
+        if (cur == end) fill(1);
+        return *cur++;
+    }
+
+    uint16 readShort() { return readBigEndian<uint16>(); }
+
+    uint32 readInt() { return readBigEndian<uint32>(); }
+
+    uint64 readLong() { return readBigEndian<uint64>(); }
+
+    /**
+     * Reads an unsigned LEB128 integer of at most 32 bits
+     */
+    uint32 readVarint() {
+        // Decodes straight from the window when the longest encoding fits in it
+        if (available() < 5) return readVarintSlow();
+        uint32 value = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint32 byte = cur[i];
+            value |= (byte & 0x7F) << (7 * i);
+            if (byte < 0x80) {
+                cur += i + 1;
+                return value;
+            }
+        }
+        if (cur[4] > 0x0F) corruptFileError();
+        value |= static_cast<uint32>(cur[4]) << 28;
+        cur += 5;
+        return value;
     }
 
-    uint16 readShort() {
-        uint8 a = readByte();
-        uint8 b = readByte();
-        return a << 8 | b;
+    uint32 readVarintSlow();
+
+    /**
+     * Reads an index, count or length, LEB128 encoded in the varint variant and a big endian T otherwise
+     */
+    template<typename T>
+    T readCompact() {
+        if (!varint) return readBigEndian<T>();
+        uint32 value = readVarint();
+        if (value > std::numeric_limits<T>::max()) corruptFileError();
+        return static_cast<T>(value);
     }
 
-    uint32 readInt() {
-        uint16 a = readShort();
-        uint16 b = readShort();
-        return a << 16 | b;
+    /**
+     * Reads a line number or pc, a zigzag LEB128 delta from previous in the varint variant
+     */
+    uint32 readDelta(uint32 previous) {
+        if (!varint) return readInt();
+        uint32 zigzag = readVarint();
+        return previous + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
     }
 
-    uint64 readLong() {
-        uint64 a = static_cast<uint64>(readInt());
-        uint32 b = readInt();
-        return a << 32 | b;
+    /**
+     * Skips count integers read with readCompact<T>()
+     */
+    template<typename T>
+    void skipCompact(size_t count = 1) {
+        if (!varint) return skip(count * sizeof(T));
+        for (size_t i = 0; i < count; ++i) readVarint();
     }
 
     [[noreturn]] void corruptFileError() {
@@ -70,7 +349,25 @@ class ElpReader {
     }
 
   public:
-    explicit ElpReader(string path);
+    /**
+     * Creates a reader for the file at path
+     * @param path the path of the file
+     * @param mode how the file is accessed. In Mode::MAPPED the strings and
+     * code arrays of the returned ElpInfo point into the mapping and are valid
+     * only until the reader is closed. A compressed file (see CompressedElp) is
+     * decompressed into memory up front and read in Mode::MEMORY whatever the mode
+     */
+    explicit ElpReader(string path, Mode mode = Mode::STREAM);
+
+    /**
+     * Creates a reader in Mode::MEMORY over a buffer holding an ELP file.
+     * The buffer is only read by this reader and the trees it returns do not point
+     * into it, except for modules read with readLazy() which keep decoding from it.
+     * A compressed buffer is decompressed up front, then only the copy is read
+     * @param data the buffer
+     * @param name the name used in error messages
+     */
+    explicit ElpReader(std::span<const std::byte> data, string name = "<memory>");
 
     /**
      * This function parses the file associated with this reader
@@ -79,14 +376,138 @@ class ElpReader {
      */
     ElpInfo read();
 
+    /**
+     * Parses the file like read(), but allocates the whole tree from the arena
+     * of the returned module. The arena is sized from the file length, and the
+     * module keeps the mapping alive in Mode::MAPPED, so the tree stays valid
+     * after this reader is closed
+     * @return The module owning the bytecode data
+     */
+    ElpModule readModule();
+
+    /**
+     * Parses the file like readModule(), but only decodes the headers of
+     * methods. The bodies are skipped over and decoded on first access
+     * through ElpModule::loadMethod(). The returned module keeps the file
+     * mapped, as that is where the bodies are decoded from. In Mode::MEMORY
+     * the buffer must outlive the module instead
+     * @return The module owning the bytecode data
+     */
+    ElpModule readLazy();
+
+    /**
+     * Parses the file like readModule(), but decodes the top level objects on
+     * a pool of worker threads. The table of contents, or a quick scan over the file
+     * without one, gives where each object starts, then every object is decoded into
+     * its slot of ElpInfo::objects.
+     * The returned module keeps the file mapped unless the reader is in Mode::MEMORY
+     * @param threads number of threads, 0 for one per hardware thread
+     * @return The module owning the bytecode data
+     */
+    ElpModule readParallel(size_t threads = 0);
+
+    /**
+     * @return the table of contents of the file, or null if it has none
+     */
+    const TocInfo *getToc();
+
+    /**
+     * Reads a single top level object. With a table of contents the reader
+     * seeks straight to it, otherwise everything in front of it is skipped over
+     * @param index index of the object in ElpInfo::objects
+     * @return the object
+     */
+    ObjInfo readObject(size_t index);
+
+    /**
+     * Reads the meta of the module, seeking straight to it with a table of contents
+     * @return the meta
+     */
+    MetaInfo readModuleMeta();
+
+    /**
+     * Finds a top level method or a method of a possibly nested class. Lambdas are
+     * part of the body of their method and are not looked at
+     * @param thisMethod the constant the method refers to as its thisMethod
+     * @return the file offset and length of the method, from its accessFlags
+     * to the end of its meta, if there is such a method
+     */
+    std::optional<TocInfo::Section> findMethod(cpidx thisMethod);
+
+    /**
+     * Finds a method like findMethod(cpidx), by the string constant its thisMethod refers to
+     * @param signature the signature of the method
+     * @return the file offset and length of the method if there is such a method
+     */
+    std::optional<TocInfo::Section> findMethod(const string &signature);
+
+    /**
+     * Reads only the fixed header and the constant pool entries up to the ones
+     * the module name and entry point refer to
+     * @return the header
+     */
+    ElpHeader probe();
+
+    /**
+     * Reads the header of the file at path like probe(), with a single small
+     * positioned read in the common case instead of opening a stream
+     * @param path the path of the file
+     * @return the header
+     * @throws errors::FileNotFoundError if the file cannot be opened
+     * @throws errors::IOError if the file cannot be read
+     * @throws errors::CorruptFileError if the file is not a valid module
+     */
+    static ElpHeader probe(const string &path);
+
+    /**
+     * Streams over the file and reports its contents to the visitor.
+     * Only the subtree currently being visited is held in memory, and
+     * subtrees the visitor declines are skipped without being decoded
+     * @param visitor the visitor
+     */
+    void accept(ElpVisitor &visitor);
+
     /**
      * Closes the file
      */
-    void close() const;
+    void close();
+
+    /**
+     * @return the file offset of the next byte to be decoded
+     */
+    size_t position() const { return baseOffset + (cur - base); }
+
+    /**
+     * Makes the reader intern every UTF-8 string it reads into a table shared with other
+     * readers, instead of giving each tree its own copy. Interned strings must not be
+     * modified. Modules read afterwards keep the table alive
+     * @param table the table, or null to stop interning
+     */
+    void setStringTable(std::shared_ptr<StringTable> table) { strings = table; }
+
+    const std::shared_ptr<StringTable> &getStringTable() const { return strings; }
+
+    Mode getMode() const { return mode; }
 
     FILE *getFile() const { return file; }
 
     const string &getPath() const { return path; }
+
+    /**
+     * @return whether the file is in the varint variant of the format, see ELP_MINOR_VARINT
+     */
+    bool isVarint() const { return varint; }
+
+    /**
+     * @return whether the file is compressed (see CompressedElp), in which case offsets
+     * such as those of getToc() and findMethod() are offsets in the decompressed module
+     */
+    bool isCompressed() const { return decompressed != null; }
+
+    /**
+     * @return the decompressed module if the file is compressed, null otherwise
+     */
+    const std::shared_ptr<const vector<std::byte>> &getDecompressed() const { return decompressed; }
 };
 
 #endif /* SOURCE_LOADER_PARSER_HPP_ */
@@ -0,0 +1,65 @@
+#ifndef ELPOPS_VISITOR_HPP
+#define ELPOPS_VISITOR_HPP
+
+#include "elpdef.hpp"
+
+/**
+ * Receives the contents of an ELP file while ElpReader::accept() streams over it.
+ * Nothing is retained between callbacks, so every structure passed to a callback
+ * (and everything it points to) is only valid during that callback.
+ * Subtrees that a visitor is not interested in are skipped without allocating
+ */
+class ElpVisitor {
+  public:
+    virtual ~ElpVisitor() = default;
+
+    /**
+     * @return whether meta tables should be decoded. If false, every meta
+     * table is skipped and passed as an empty table
+     */
+    virtual bool visitMeta() const { return true; }
+
+    /**
+     * Called with the fixed part of the header, the constant pool,
+     * globals, objects and meta of header are not set
+     */
+    virtual void onHeader(const ElpInfo & /*header*/) {}
+
+    virtual void onConstant(cpidx /*index*/, const CpInfo & /*constant*/) {}
+
+    virtual void onGlobal(const GlobalInfo & /*global*/) {}
+
+    /**
+     * Called with a class whose header (type, access flags, name, type params and supers)
+     * is decoded, the members are visited afterwards
+     * @return whether the members of the class should be visited
+     */
+    virtual bool onClassBegin(const ClassInfo & /*klass*/) { return true; }
+
+    virtual void onField(const FieldInfo & /*field*/) {}
+
+    /**
+     * Called after the members of a class are visited, with its header, member counts and meta set.
+     * The members themselves were passed to their own callbacks, so fields, methods and objects are null
+     */
+    virtual void onClassEnd(const ClassInfo & /*klass*/) {}
+
+    /**
+     * Called with a method whose header (everything up to the locals) is decoded
+     * @return whether the body of the method should be decoded and passed to onCode()
+     */
+    virtual bool onMethod(const MethodInfo & /*method*/) { return true; }
+
+    /**
+     * Called with a method whose body (code, exception table, line info,
+     * lambdas, matches and meta) is decoded
+     */
+    virtual void onCode(const MethodInfo & /*method*/) {}
+
+    /**
+     * Called with the meta table of the module
+     */
+    virtual void onMeta(const MetaInfo & /*meta*/) {}
+};
+
+#endif    // ELPOPS_VISITOR_HPP
@@ -1,218 +1,147 @@
 #include "writer.hpp"
+#include "../spimp/parallel.hpp"
+#include "compress.hpp"
 
 ElpWriter::ElpWriter(const string &filename) : path(filename) {
     file = fopen(filename.c_str(), "wb");
     if (file == null) throw errors::FileNotFoundError(filename);
 }
 
-void ElpWriter::close() const {
-    fclose(file);
-}
-
-void ElpWriter::write(ElpInfo elp) {
-    write(elp.magic);
-    write(elp.minorVersion);
-    write(elp.majorVersion);
-    write(elp.compiledFrom);
-    write(elp.type);
-    write(elp.thisModule);
-    write(elp.init);
-    write(elp.entry);
-    write(elp.imports);
-    write(elp.constantPoolCount);
-    for (int i = 0; i < elp.constantPoolCount; ++i) {
-        write(elp.constantPool[i]);
-    }
-    write(elp.globalsCount);
-    for (int i = 0; i < elp.globalsCount; ++i) {
-        write(elp.globals[i]);
-    }
-    write(elp.objectsCount);
-    for (int i = 0; i < elp.objectsCount; ++i) {
-        write(elp.objects[i]);
-    }
-    write(elp.meta);
-}
-
-void ElpWriter::write(CpInfo info) {
-    write(info.tag);
-    switch (info.tag) {
-        case 0x03:
-            write(info._char);
-            break;
-        case 0x04:
-            write(info._int);
-            break;
-        case 0x05:
-            write(info._float);
-            break;
-        case 0x06:
-            write(info._string);
-            break;
-        case 0x07:
-            write(info._array);
-            break;
-        default:
-            throw errors::Unreachable();
-    }
-}
-
-void ElpWriter::write(__UTF8 utf) {
-    write(utf.len);
-    for (int i = 0; i < utf.len; ++i) {
-        write(utf.bytes[i]);
-    }
-}
-
-void ElpWriter::write(__Container con) {
-    write(con.len);
-    for (int i = 0; i < con.len; ++i) {
-        write(con.items[i]);
-    }
-}
-
-void ElpWriter::write(GlobalInfo info) {
-    write(info.flags);
-    write(info.thisGlobal);
-    write(info.type);
-    write(info.meta);
-}
-
-void ElpWriter::write(ObjInfo info) {
-    write(info.type);
-    switch (info.type) {
-        case 0x01:
-            write(info._method);
-            break;
-        case 0x02:
-            write(info._class);
-            break;
-        default:
-            throw errors::Unreachable();
-    }
-}
-
-void ElpWriter::write(MethodInfo info) {
-    write(info.accessFlags);
-    write(info.type);
-    write(info.thisMethod);
-    write(info.typeParamCount);
-    for (int i = 0; i < info.typeParamCount; ++i) {
-        write(info.typeParams[i]);
-    }
-    write(info.argsCount);
-    for (int i = 0; i < info.argsCount; ++i) {
-        write(info.args[i]);
-    }
-    write(info.localsCount);
-    write(info.closureStart);
-    for (int i = 0; i < info.localsCount; ++i) {
-        write(info.locals[i]);
-    }
-    write(info.maxStack);
-    write(info.codeCount);
-    for (int i = 0; i < info.codeCount; ++i) {
-        write(info.code[i]);
-    }
-    write(info.exceptionTableCount);
-    for (int i = 0; i < info.exceptionTableCount; ++i) {
-        write(info.exceptionTable[i]);
-    }
-    write(info.lineInfo);
-    write(info.lambdaCount);
-    for (int i = 0; i < info.lambdaCount; ++i) {
-        write(info.lambdas[i]);
-    }
-    write(info.matchCount);
-    for (int i = 0; i < info.matchCount; ++i) {
-        write(info.matches[i]);
-    }
-    write(info.meta);
-}
-
-void ElpWriter::write(MethodInfo::LineInfo line) {
-    write(line.numberCount);
-    for (int i = 0; i < line.numberCount; ++i) {
-        auto info = line.numbers[i];
-        write(info.times);
-        write(info.lineno);
-    }
-}
-
-void ElpWriter::write(MethodInfo::ArgInfo info) {
-    write(info.thisArg);
-    write(info.type);
-    write(info.meta);
-}
-
-void ElpWriter::write(MethodInfo::LocalInfo info) {
-    write(info.thisLocal);
-    write(info.type);
-    write(info.meta);
-}
-
-void ElpWriter::write(MethodInfo::ExceptionTableInfo info) {
-    write(info.startPc);
-    write(info.endPc);
-    write(info.targetPc);
-    write(info.exception);
-    write(info.meta);
-}
-
-void ElpWriter::write(MethodInfo::MatchInfo info) {
-    write(info.caseCount);
-    for (int i = 0; i < info.caseCount; ++i) {
-        write(info.cases[i]);
-    }
-    write(info.defaultLocation);
-    write(info.meta);
-}
-
-void ElpWriter::write(MethodInfo::MatchInfo::CaseInfo info) {
-    write(info.value);
-    write(info.location);
-}
+ElpWriter::ElpWriter(vector<std::byte> &output) : path("<memory>"), output(&output) {}
 
-void ElpWriter::write(ClassInfo info) {
-    write(info.type);
-    write(info.accessFlags);
-    write(info.thisClass);
-    write(info.typeParamCount);
-    for (int i = 0; i < info.typeParamCount; ++i) {
-        write(info.typeParams[i]);
-    }
-    write(info.supers);
-    write(info.fieldsCount);
-    for (int i = 0; i < info.fieldsCount; ++i) {
-        write(info.fields[i]);
-    }
-    write(info.methodsCount);
-    for (int i = 0; i < info.methodsCount; ++i) {
-        write(info.methods[i]);
-    }
-    write(info.objectsCount);
-    for (int i = 0; i < info.objectsCount; ++i) {
-        write(info.objects[i]);
+ElpWriter::~ElpWriter() {
+    try {
+        close();
+    } catch (const errors::IOError &) {
+        // Destructors must not throw, call close() to see write errors
     }
-    write(info.meta);
 }
-
-void ElpWriter::write(FieldInfo info) {
-    write(info.flags);
-    write(info.thisField);
-    write(info.type);
-    write(info.meta);
-}
-
-void ElpWriter::write(TypeParamInfo info) {
-    write(info.name);
-}
-
-void ElpWriter::write(MetaInfo info) {
-    write(info.len);
-    for (int i = 0; i < info.len; ++i) {
-        auto meta = info.table[i];
-        write(meta.key);
-        write(meta.value);
-    }
+
+void ElpWriter::close() {
+    if (file == null) return;
+    bool failed = buffered > 0 && fwrite(buffer.data(), 1, buffered, file) != buffered;
+    buffered = 0;
+    failed |= fclose(file) != 0;
+    file = null;
+    if (failed) throw errors::IOError(path, "cannot write file");
+}
+
+void ElpWriter::checkOpen() const {
+    if (file == null && output == null) throw errors::IOError(path, "writer is closed");
+}
+
+void ElpWriter::flush() {
+    if (buffered == 0) return;
+    checkOpen();
+    if (output != null) {
+        auto bytes = reinterpret_cast<const std::byte *>(buffer.data());
+        output->insert(output->end(), bytes, bytes + buffered);
+    } else if (file != null && fwrite(buffer.data(), 1, buffered, file) != buffered) {
+        throw errors::IOError(path, "cannot write file");
+    }
+    buffered = 0;
+}
+
+void ElpWriter::writeBytes(const uint8 *bytes, size_t count) {
+    position += count;
+    if (BUFFER_SIZE - buffered < count) {
+        flush();
+        if (count >= BUFFER_SIZE) {
+            // Too large to be worth buffering, hand it over directly
+            checkOpen();
+            if (output != null) {
+                auto data = reinterpret_cast<const std::byte *>(bytes);
+                output->insert(output->end(), data, data + count);
+            } else if (file != null && fwrite(bytes, 1, count, file) != count) {
+                throw errors::IOError(path, "cannot write file");
+            }
+            return;
+        }
+    }
+    memcpy(buffer.data() + buffered, bytes, count);
+    buffered += count;
+}
+
+void ElpWriter::writeParallel(const ElpInfo &elp, size_t threads) {
+    checkOpen();
+    auto bytes = compression ? compressElp(elp, threads, tableOfContents) : encodeParallel(elp, threads, tableOfContents);
+    writeBytes(reinterpret_cast<const uint8 *>(bytes.data()), bytes.size());
+    flush();
+}
+
+void ElpWriter::write(const ElpInfo &elp) {
+    checkOpen();
+    if (compression) {
+        auto bytes = compressElp(elp, 1, tableOfContents);
+        writeBytes(reinterpret_cast<const uint8 *>(bytes.data()), bytes.size());
+        flush();
+        return;
+    }
+    ElpEncoder<ElpWriter> encoder{*this, tableOfContents};
+    encoder.write(elp);
+    flush();
+}
+
+size_t serializedSize(const ElpInfo &elp, bool tableOfContents) {
+    SizeSink sink;
+    ElpEncoder<SizeSink> encoder{sink, tableOfContents};
+    encoder.write(elp);
+    return sink.getPosition();
+}
+
+size_t encode(const ElpInfo &elp, std::span<std::byte> dest, bool tableOfContents) {
+    size_t size = serializedSize(elp, tableOfContents);
+    if (dest.size() < size) throw std::length_error("encode(): buffer too small for ELP module");
+    BufferSink sink{reinterpret_cast<uint8 *>(dest.data())};
+    ElpEncoder<BufferSink> encoder{sink, tableOfContents};
+    encoder.write(elp);
+    return size;
+}
+
+vector<std::byte> encode(const ElpInfo &elp, bool tableOfContents) {
+    vector<std::byte> output(serializedSize(elp, tableOfContents));
+    BufferSink sink{reinterpret_cast<uint8 *>(output.data())};
+    ElpEncoder<BufferSink> encoder{sink, tableOfContents};
+    encoder.write(elp);
+    return output;
+}
+
+vector<std::byte> encodeParallel(const ElpInfo &elp, size_t threads, bool tableOfContents) {
+    // Objects only depend on the constant pool, so each one can be sized and encoded on its own.
+    // The sizes give every object its offset, then all of them are encoded in place at once
+    bool varint = (elp.minorVersion & ELP_MINOR_VARINT) != 0;
+    vector<size_t> sizes(elp.objectsCount);
+    parallelFor(elp.objectsCount, threads, [&](size_t i, size_t) {
+        SizeSink sink;
+        ElpEncoder<SizeSink> encoder{sink};
+        encoder.setVarint(varint);
+        encoder.writeObject(elp.objects[i]);
+        sizes[i] = sink.getPosition();
+    });
+    SizeSink sizeSink;
+    ElpEncoder<SizeSink> sizeEncoder{sizeSink, tableOfContents};
+    sizeEncoder.writeHead(elp);
+    vector<size_t> offsets(elp.objectsCount);
+    for (size_t i = 0; i < elp.objectsCount; ++i) {
+        offsets[i] = sizeSink.getPosition();
+        sizeEncoder.skipObject(sizes[i]);
+    }
+    sizeEncoder.writeTail(elp);
+
+    vector<std::byte> output(sizeSink.getPosition());
+    auto data = reinterpret_cast<uint8 *>(output.data());
+    parallelFor(elp.objectsCount, threads, [&](size_t i, size_t) {
+        BufferSink sink{data + offsets[i]};
+        ElpEncoder<BufferSink> encoder{sink};
+        encoder.setVarint(varint);
+        encoder.writeObject(elp.objects[i]);
+    });
+    BufferSink sink{data};
+    ElpEncoder<BufferSink> encoder{sink, tableOfContents};
+    encoder.writeHead(elp);
+    for (size_t i = 0; i < elp.objectsCount; ++i) {
+        encoder.skipObject(sizes[i]);
+    }
+    encoder.writeTail(elp);
+    return output;
 }
@@ -1,82 +1,153 @@
 #ifndef VELOCITY_WRITER_HPP
 #define VELOCITY_WRITER_HPP
 
+#include "encoder.hpp"
 #include "reader.hpp"
 
 class ElpWriter {
+    template<typename Sink>
+    friend class ElpEncoder;
+
   private:
     string path;
-    FILE *file;
-
-    void write(uint8 i) { fputc(i, file); }
+    FILE *file = null;
+    /// The buffer written to when not writing to a file
+    vector<std::byte> *output = null;
+    /// Number of bytes written so far
+    size_t position = 0;
+    /// Whether a table of contents is appended to the module
+    bool tableOfContents = false;
+    /// Whether the module is written compressed
+    bool compression = false;
+
+    /// Size of the buffer output is collected in before it is written out
+    static constexpr size_t BUFFER_SIZE = 64 * 1024;
+
+    vector<uint8> buffer = vector<uint8>(BUFFER_SIZE);
+    /// Number of bytes in the buffer that are yet to be written out
+    size_t buffered = 0;
 
-    void write(uint16 i) {
-        write(static_cast<uint8>(i >> 8));
-        write(static_cast<uint8>(i & 0xFF));
-    }
+    /**
+     * @throws errors::IOError if the file was closed
+     */
+    void checkOpen() const;
 
-    void write(uint32 i) {
-        write(static_cast<uint16>(i >> 16));
-        write(static_cast<uint16>(i & 0xFFFF));
-    }
+    /**
+     * Writes the buffered bytes to the file or the output buffer
+     */
+    void flush();
 
-    void write(uint64 i) {
-        write(static_cast<uint32>(i >> 32));
-        write(static_cast<uint32>(i & 0xFFFFFFFF));
+    /**
+     * Writes count bytes as they are
+     */
+    void writeBytes(const uint8 *bytes, size_t count);
+
+    template<typename T>
+    void writeBigEndian(T value) {
+        if (BUFFER_SIZE - buffered < sizeof(T)) flush();
+        storeBigEndian(buffer.data() + buffered, value);
+        buffered += sizeof(T);
+        position += sizeof(T);
     }
 
-    void write(CpInfo info);
-
-    void write(__UTF8 utf);
-
-    void write(__Container con);
-
-    void write(GlobalInfo info);
-
-    void write(ObjInfo info);
-
-    void write(MethodInfo info);
-
-    void write(MethodInfo::LineInfo line);
-
-    void write(MethodInfo::ArgInfo info);
-
-    void write(MethodInfo::LocalInfo info);
-
-    void write(MethodInfo::ExceptionTableInfo info);
-
-    void write(MethodInfo::MatchInfo info);
+    size_t getPosition() const { return position; }
 
-    void write(MethodInfo::MatchInfo::CaseInfo info);
-
-    void write(ClassInfo info);
+  public:
+    explicit ElpWriter(const string &filename);
 
-    void write(FieldInfo info);
+    /**
+     * Creates a writer that appends to a byte buffer instead of a file.
+     * The buffer can be read back with ElpReader(std::span<const std::byte>)
+     * @param output the buffer, must outlive the writer
+     */
+    explicit ElpWriter(vector<std::byte> &output);
 
-    void write(TypeParamInfo info);
+    ElpWriter(const ElpWriter &) = delete;
 
-    void write(MetaInfo info);
+    ElpWriter &operator=(const ElpWriter &) = delete;
 
-  public:
-    explicit ElpWriter(const string &filename);
+    /**
+     * Closes the file if it is still open
+     */
+    ~ElpWriter();
 
     /**
      * Writes the binary information given in the form of ElpInfo
      * in binary form which is readable by ElpReader to the file specified
-     * during constructing the object
+     * during constructing the object. Output is buffered, and everything written
+     * is handed to the file or the output buffer by the time this returns
      * @param elp ELP information object
+     * @throws errors::IOError if the file cannot be written or was closed
+     */
+    void write(const ElpInfo &elp);
+
+    /**
+     * Writes a module like write(), but encodes its top level objects on a pool
+     * of worker threads with encodeParallel(). The output is the same
+     * @param elp ELP information object
+     * @param threads number of threads, 0 for one per hardware thread
+     * @throws errors::IOError if the file cannot be written or was closed
+     */
+    void writeParallel(const ElpInfo &elp, size_t threads = 0);
+
+    /**
+     * Sets whether a table of contents (see TocInfo) is appended to the modules written
+     * by this writer. It is off by default
+     */
+    void setTableOfContents(bool enabled) { tableOfContents = enabled; }
+
+    /**
+     * Sets whether the modules written by this writer are compressed with compressElp().
+     * ElpReader reads them like any other module. It is off by default
      */
-    void write(ElpInfo elp);
+    void setCompression(bool enabled) { compression = enabled; }
 
     /**
-     * Closes the file
+     * Closes the file, does nothing when writing to a buffer
+     * @throws errors::IOError if the buffered output cannot be written
      */
-    void close() const;
+    void close();
 
     const string &getPath() const { return path; }
 
     FILE *getFile() const { return file; }
 };
 
+/**
+ * Computes the exact number of bytes ElpWriter writes for a module
+ * @param elp the module
+ * @param tableOfContents whether a table of contents is included
+ * @return the size in bytes
+ */
+size_t serializedSize(const ElpInfo &elp, bool tableOfContents = false);
+
+/**
+ * Encodes a module into dest the same way ElpWriter does, without any intermediate buffering
+ * @param elp the module
+ * @param dest the buffer, at least serializedSize() bytes long
+ * @param tableOfContents whether a table of contents is included
+ * @return the number of bytes written
+ * @throws std::length_error if dest is too small
+ */
+size_t encode(const ElpInfo &elp, std::span<std::byte> dest, bool tableOfContents = false);
+
+/**
+ * Encodes a module the same way ElpWriter does into a buffer allocated once at its exact size
+ * @param elp the module
+ * @param tableOfContents whether a table of contents is included
+ * @return the encoded module
+ */
+vector<std::byte> encode(const ElpInfo &elp, bool tableOfContents = false);
+
+/**
+ * Encodes a module like encode(), but sizes and then encodes its top level objects
+ * on a pool of worker threads. Every object is encoded straight to its final offset
+ * in the output, and the bytes are the same as those of encode()
+ * @param elp the module
+ * @param threads number of threads, 0 for one per hardware thread
+ * @param tableOfContents whether a table of contents is included
+ * @return the encoded module
+ */
+vector<std::byte> encodeParallel(const ElpInfo &elp, size_t threads = 0, bool tableOfContents = false);
 
 #endif    // VELOCITY_WRITER_HPP
@@ -0,0 +1,87 @@
+#include "arena.hpp"
+#include <algorithm>
+
+Arena::Arena(size_t initialSize) : chunkSize(std::max(initialSize, MIN_CHUNK_SIZE)) {}
+
+Arena::Arena(Arena &&other) noexcept
+    : head(other.head), cur(other.cur), end(other.end), chunkSize(other.chunkSize), spare(other.spare) {
+    other.head = other.spare = null;
+    other.cur = other.end = null;
+}
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+    if (this != &other) {
+        release();
+        head = other.head;
+        cur = other.cur;
+        end = other.end;
+        chunkSize = other.chunkSize;
+        spare = other.spare;
+        other.head = other.spare = null;
+        other.cur = other.end = null;
+    }
+    return *this;
+}
+
+Arena::~Arena() {
+    release();
+}
+
+void Arena::grow(size_t size, size_t align) {
+    size_t needed = sizeof(Chunk) + size + align;
+    Chunk *chunk;
+    if (spare != null && spare->size >= needed) {
+        chunk = spare;
+        spare = null;
+    } else {
+        // Chunks double in size so that a bad initial estimate costs only a few allocations
+        size_t newSize = std::max(chunkSize, needed);
+        chunk = static_cast<Chunk *>(::operator new(newSize));
+        chunk->size = newSize;
+        chunkSize = newSize * 2;
+    }
+    chunk->next = head;
+    head = chunk;
+    cur = reinterpret_cast<uint8 *>(chunk + 1);
+    end = reinterpret_cast<uint8 *>(chunk) + chunk->size;
+}
+
+void Arena::free(Chunk *chunk) {
+    if (spare == null || chunk->size > spare->size) std::swap(chunk, spare);
+    ::operator delete(chunk);
+}
+
+void Arena::rewind(const Mark &mark) {
+    if (mark.chunk == null && head != null) {
+        // Rewinding to the very start keeps the newest (largest) chunk for reuse
+        Chunk *chunk = head->next;
+        while (chunk != null) {
+            Chunk *next = chunk->next;
+            ::operator delete(chunk);
+            chunk = next;
+        }
+        head->next = null;
+        cur = reinterpret_cast<uint8 *>(head + 1);
+        end = reinterpret_cast<uint8 *>(head) + head->size;
+        return;
+    }
+    while (head != mark.chunk) {
+        Chunk *next = head->next;
+        free(head);
+        head = next;
+    }
+    cur = mark.cur;
+    end = mark.end;
+    chunkSize = mark.chunkSize;
+}
+
+void Arena::release() {
+    while (head != null) {
+        Chunk *next = head->next;
+        ::operator delete(head);
+        head = next;
+    }
+    ::operator delete(spare);
+    spare = null;
+    cur = end = null;
+}
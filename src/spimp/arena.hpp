@@ -0,0 +1,105 @@
+#ifndef ELPOPS_ARENA_HPP
+#define ELPOPS_ARENA_HPP
+
+#include "common.hpp"
+#include <memory>
+#include <type_traits>
+
+/**
+ * A bump allocator that hands out memory from large chunks.
+ * Individual allocations are never freed, all of them are released at once
+ * when the arena is released or destroyed. Only trivially destructible
+ * objects can be allocated as their destructors are never run
+ */
+class Arena {
+  private:
+    struct Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    static constexpr size_t MIN_CHUNK_SIZE = 4 * 1024;
+
+    Chunk *head = null;
+    uint8 *cur = null;
+    uint8 *end = null;
+    size_t chunkSize;
+    /// The largest chunk freed by rewind(), reused by grow() before allocating a new one
+    Chunk *spare = null;
+
+    void grow(size_t size, size_t align);
+
+    /// Frees a chunk, or keeps it as the spare if it is larger than the current one
+    void free(Chunk *chunk);
+
+  public:
+    /// A position in the arena that can be rewound to
+    struct Mark {
+        Chunk *chunk;
+        uint8 *cur;
+        uint8 *end;
+        /// Size of the next chunk, restored so that rewinding does not keep doubling it
+        size_t chunkSize;
+    };
+
+    /**
+     * Creates an arena
+     * @param initialSize size of the first chunk, allocated on first use
+     */
+    explicit Arena(size_t initialSize = 64 * 1024);
+
+    Arena(const Arena &) = delete;
+
+    Arena(Arena &&other) noexcept;
+
+    Arena &operator=(const Arena &) = delete;
+
+    Arena &operator=(Arena &&other) noexcept;
+
+    ~Arena();
+
+    /**
+     * Allocates size bytes aligned to align
+     */
+    void *allocate(size_t size, size_t align) {
+        auto p = reinterpret_cast<uintptr_t>(cur);
+        auto aligned = (p + align - 1) & ~(uintptr_t(align) - 1);
+        if (cur == null || aligned + size > reinterpret_cast<uintptr_t>(end)) {
+            grow(size, align);
+            p = reinterpret_cast<uintptr_t>(cur);
+            aligned = (p + align - 1) & ~(uintptr_t(align) - 1);
+        }
+        cur = reinterpret_cast<uint8 *>(aligned + size);
+        return reinterpret_cast<void *>(aligned);
+    }
+
+    /**
+     * Allocates an array of count default initialized objects
+     */
+    template<typename T>
+    T *alloc(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "Arena::alloc(): type must be trivially destructible");
+        auto items = static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_default_construct_n(items, count);
+        return items;
+    }
+
+    /**
+     * @return the current position of the arena
+     */
+    Mark mark() const { return {head, cur, end, chunkSize}; }
+
+    /**
+     * Frees everything allocated after the mark was taken. The largest chunk freed
+     * is kept for the next allocation that does not fit, so a scan that repeatedly
+     * marks, allocates and rewinds holds on to a bounded amount of memory
+     */
+    void rewind(const Mark &mark);
+
+    /**
+     * Frees all memory held by the arena
+     */
+    void release();
+};
+
+#endif    // ELPOPS_ARENA_HPP
@@ -0,0 +1,342 @@
+#include "asyncio.hpp"
+#include "exceptions.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <exception>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define SPUTILS_HAS_PREAD
+#    include <fcntl.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#if defined(__linux__)
+#    define SPUTILS_HAS_IO_URING
+#    include <linux/io_uring.h>
+#    include <sys/mman.h>
+#    include <sys/syscall.h>
+#endif
+
+#ifdef SPUTILS_HAS_PREAD
+static int openFile(const string &path, bool write) {
+    int fd = write ? ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (write) throw errors::IOError(path, strerror(errno));
+        throw errors::FileNotFoundError(path);
+    }
+    return fd;
+}
+
+static size_t fileSize(int fd, const string &path) {
+    struct stat st {};
+    if (fstat(fd, &st) != 0) throw errors::IOError(path, strerror(errno));
+    return st.st_size;
+}
+
+/**
+ * Transfers the rest of the bytes of a transfer synchronously
+ * @return the number of bytes transferred, which is short only if the file ended early
+ */
+static size_t transferRest(int fd, bool write, std::byte *data, size_t offset, size_t size, const string &path) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t result = write ? pwrite(fd, data + done, size - done, offset + done) : pread(fd, data + done, size - done, offset + done);
+        if (result < 0 && errno == EINTR) continue;
+        if (result < 0) throw errors::IOError(path, strerror(errno));
+        if (result == 0) break;
+        done += result;
+    }
+    return done;
+}
+#endif
+
+#ifdef SPUTILS_HAS_IO_URING
+struct AsyncFileIO::Ring {
+    int fd = -1;
+    io_uring_params params{};
+    void *sqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    void *cqRing = MAP_FAILED;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    io_uring_cqe *cqes;
+    /// Number of queued entries not yet submitted to the kernel
+    unsigned pending = 0;
+
+    /**
+     * @return the ring, or null if io_uring is not available
+     */
+    static Ring *create(unsigned entries) {
+        auto ring = new Ring();
+        ring->fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &ring->params));
+        if (ring->fd < 0 || !ring->map()) {
+            delete ring;
+            return null;
+        }
+        return ring;
+    }
+
+    bool map() {
+        auto &p = params;
+        sqRingSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqRingSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        sqRing = mmap(null, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(null, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) return false;
+        }
+        void *sqeMap = mmap(null, p.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQES);
+        if (sqeMap == MAP_FAILED) return false;
+        sqes = static_cast<io_uring_sqe *>(sqeMap);
+        auto sq = static_cast<uint8 *>(sqRing);
+        auto cq = static_cast<uint8 *>(cqRing);
+        sqHead = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sqTail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+        if (fd >= 0) ::close(fd);
+    }
+
+    /**
+     * Queues a request, the caller makes sure the ring has room for it
+     */
+    void push(const io_uring_sqe &sqe) {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        sqes[index] = sqe;
+        sqArray[index] = index;
+        std::atomic_ref<unsigned>(*sqTail).store(tail + 1, std::memory_order_release);
+        pending++;
+    }
+
+    /**
+     * Submits the queued requests and waits for at least one completion
+     */
+    void submitAndWait() {
+        while (true) {
+            long result = syscall(__NR_io_uring_enter, fd, pending, 1, IORING_ENTER_GETEVENTS, null, 0);
+            if (result >= 0) {
+                pending -= result;
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) throw errors::IOError("io_uring", strerror(errno));
+        }
+    }
+
+    bool pop(io_uring_cqe &cqe) {
+        unsigned head = *cqHead;
+        if (head == std::atomic_ref<unsigned>(*cqTail).load(std::memory_order_acquire)) return false;
+        cqe = cqes[head & *cqMask];
+        std::atomic_ref<unsigned>(*cqHead).store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+#else
+struct AsyncFileIO::Ring {};
+#endif
+
+AsyncFileIO::AsyncFileIO(unsigned queueDepth, bool useRing) : queueDepth(std::max(queueDepth, 1u)) {
+#ifdef SPUTILS_HAS_IO_URING
+    if (useRing) ring = Ring::create(this->queueDepth);
+    // The kernel may round the ring size, never queue more than it holds
+    if (ring != null) this->queueDepth = std::min(this->queueDepth, ring->params.sq_entries);
+#endif
+}
+
+AsyncFileIO::~AsyncFileIO() {
+    delete ring;
+}
+
+void AsyncFileIO::readFiles(const vector<string> &paths, const std::function<void(size_t, vector<std::byte> &)> &onRead) {
+#ifdef SPUTILS_HAS_PREAD
+    auto start = [&](size_t index, Transfer &transfer) {
+        transfer.fd = openFile(paths[index], false);
+        transfer.data.resize(fileSize(transfer.fd, paths[index]));
+        return true;
+    };
+    run(paths.size(), false, paths.data(), start, [&](Transfer &transfer) { onRead(transfer.index, transfer.data); });
+#else
+    for (size_t i = 0; i < paths.size(); ++i) {
+        FILE *file = fopen(paths[i].c_str(), "rb");
+        if (file == null) throw errors::FileNotFoundError(paths[i]);
+        fseek(file, 0, SEEK_END);
+        vector<std::byte> data(ftell(file));
+        fseek(file, 0, SEEK_SET);
+        data.resize(fread(data.data(), 1, data.size(), file));
+        fclose(file);
+        onRead(i, data);
+    }
+#endif
+}
+
+void AsyncFileIO::writeFiles(const vector<string> &paths, const std::function<void(size_t, vector<std::byte> &)> &produce) {
+#ifdef SPUTILS_HAS_PREAD
+    auto start = [&](size_t index, Transfer &transfer) {
+        produce(index, transfer.data);
+        transfer.fd = openFile(paths[index], true);
+        return true;
+    };
+    run(paths.size(), true, paths.data(), start, [](Transfer &) {});
+#else
+    for (size_t i = 0; i < paths.size(); ++i) {
+        vector<std::byte> data;
+        produce(i, data);
+        FILE *file = fopen(paths[i].c_str(), "wb");
+        if (file == null) throw errors::IOError(paths[i], "cannot open file");
+        size_t written = fwrite(data.data(), 1, data.size(), file);
+        fclose(file);
+        if (written != data.size()) throw errors::IOError(paths[i], "short write");
+    }
+#endif
+}
+
+void AsyncFileIO::run(size_t count, bool write, const string *paths, const std::function<bool(size_t, Transfer &)> &start,
+                      const std::function<void(Transfer &)> &finish) {
+#ifdef SPUTILS_HAS_PREAD
+    if (ring == null) {
+        // Synchronous fallback, one file at a time
+        for (size_t i = 0; i < count; ++i) {
+            Transfer transfer{i, -1, {}, 0};
+            try {
+                if (!start(i, transfer)) {
+                    if (transfer.fd >= 0) ::close(transfer.fd);
+                    continue;
+                }
+                size_t done = transferRest(transfer.fd, write, transfer.data.data(), 0, transfer.data.size(), paths[i]);
+                if (write && done < transfer.data.size()) throw errors::IOError(paths[i], "short write");
+                transfer.data.resize(done);
+            } catch (...) {
+                if (transfer.fd >= 0) ::close(transfer.fd);
+                throw;
+            }
+            ::close(transfer.fd);
+            finish(transfer);
+        }
+        return;
+    }
+#endif
+#ifdef SPUTILS_HAS_IO_URING
+    vector<Transfer> slots(queueDepth);
+    vector<unsigned> freeSlots;
+    for (unsigned i = queueDepth; i > 0; --i) freeSlots.push_back(i - 1);
+    std::exception_ptr error;
+    size_t next = 0;
+    unsigned inflight = 0;
+
+    auto submit = [&](unsigned slot) {
+        Transfer &transfer = slots[slot];
+        io_uring_sqe sqe{};
+        sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe.fd = transfer.fd;
+        sqe.addr = reinterpret_cast<uint64>(transfer.data.data() + transfer.done);
+        // A single request moves at most INT_MAX bytes, the rest is resubmitted as a short transfer
+        sqe.len = static_cast<uint32>(std::min<size_t>(transfer.data.size() - transfer.done, INT_MAX));
+        sqe.off = transfer.done;
+        sqe.user_data = slot;
+        ring->push(sqe);
+    };
+    auto complete = [&](unsigned slot) {
+        Transfer &transfer = slots[slot];
+        ::close(transfer.fd);
+        inflight--;
+        freeSlots.push_back(slot);
+        if (!error) {
+            try {
+                finish(transfer);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        transfer.data = {};
+    };
+
+    while ((next < count && !error) || inflight > 0) {
+        while (!error && next < count && inflight < queueDepth) {
+            unsigned slot = freeSlots.back();
+            Transfer &transfer = slots[slot];
+            transfer = {next, -1, {}, 0};
+            try {
+                if (!start(next++, transfer)) {
+                    if (transfer.fd >= 0) ::close(transfer.fd);
+                    continue;
+                }
+            } catch (...) {
+                if (transfer.fd >= 0) ::close(transfer.fd);
+                error = std::current_exception();
+                break;
+            }
+            freeSlots.pop_back();
+            inflight++;
+            if (transfer.data.empty()) {
+                complete(slot);
+            } else {
+                submit(slot);
+            }
+        }
+        if (inflight == 0) continue;
+        ring->submitAndWait();
+        io_uring_cqe cqe;
+        while (ring->pop(cqe)) {
+            auto slot = static_cast<unsigned>(cqe.user_data);
+            Transfer &transfer = slots[slot];
+            const string &path = paths[transfer.index];
+            if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+                submit(slot);
+                continue;
+            }
+            if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP) {
+                // The kernel does not support this request, finish it synchronously
+                try {
+                    size_t rest = transfer.data.size() - transfer.done;
+                    size_t done = transferRest(transfer.fd, write, transfer.data.data() + transfer.done, transfer.done, rest, path);
+                    if (write && done < rest) throw errors::IOError(path, "short write");
+                    transfer.done += done;
+                    transfer.data.resize(transfer.done);
+                } catch (...) {
+                    if (!error) error = std::current_exception();
+                }
+                complete(slot);
+                continue;
+            }
+            if (cqe.res < 0) {
+                if (!error) error = std::make_exception_ptr(errors::IOError(path, strerror(-cqe.res)));
+                complete(slot);
+                continue;
+            }
+            if (cqe.res == 0) {
+                // The file ended early
+                if (write && !error) error = std::make_exception_ptr(errors::IOError(path, "short write"));
+                transfer.data.resize(transfer.done);
+            }
+            transfer.done += cqe.res;
+            if (transfer.done < transfer.data.size()) {
+                submit(slot);
+            } else {
+                complete(slot);
+            }
+        }
+    }
+    if (error) std::rethrow_exception(error);
+#endif
+}
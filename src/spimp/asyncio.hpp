@@ -0,0 +1,75 @@
+#ifndef ELPOPS_ASYNCIO_HPP
+#define ELPOPS_ASYNCIO_HPP
+
+#include "common.hpp"
+#include <functional>
+
+/**
+ * Reads and writes whole files with many requests in flight at once.
+ * On Linux the requests are submitted through io_uring, so the number of
+ * outstanding reads or writes follows the queue depth instead of being one
+ * blocking syscall at a time. Where io_uring is not available, plain
+ * pread/pwrite is used instead
+ */
+class AsyncFileIO {
+  private:
+    struct Ring;
+
+    /// A file being read or written
+    struct Transfer {
+        size_t index;
+        int fd;
+        vector<std::byte> data;
+        size_t done;
+    };
+
+    unsigned queueDepth;
+    Ring *ring = null;
+
+    /**
+     * Runs count transfers through the ring, at most queueDepth at a time.
+     * start(index, transfer) opens the file and fills in the transfer, returning
+     * false if there is nothing to transfer. finish(transfer) is called once all of its bytes are done.
+     * The file descriptor left in the transfer is closed by run, even if start throws
+     */
+    void run(size_t count, bool write, const string *paths, const std::function<bool(size_t, Transfer &)> &start,
+             const std::function<void(Transfer &)> &finish);
+
+  public:
+    /**
+     * @param queueDepth maximum number of requests in flight
+     * @param useRing whether to try io_uring at all
+     */
+    explicit AsyncFileIO(unsigned queueDepth = 64, bool useRing = true);
+
+    AsyncFileIO(const AsyncFileIO &) = delete;
+
+    AsyncFileIO &operator=(const AsyncFileIO &) = delete;
+
+    ~AsyncFileIO();
+
+    /**
+     * @return whether requests go through io_uring
+     */
+    bool isAsync() const { return ring != null; }
+
+    /**
+     * Reads the files. onRead(index, data) is called on the calling thread as each
+     * file completes, in completion order, while the other reads stay in flight.
+     * If onRead throws, the outstanding requests are drained and the exception is rethrown
+     * @param paths the paths of the files
+     * @param onRead receives the index of the file in paths and its contents
+     */
+    void readFiles(const vector<string> &paths, const std::function<void(size_t, vector<std::byte> &)> &onRead);
+
+    /**
+     * Writes the files. produce(index, data) fills the contents of a file just before
+     * its write is submitted, so producing the next file overlaps the writes in flight.
+     * Files are produced in order
+     * @param paths the paths of the files
+     * @param produce receives the index of the file in paths and the buffer to fill
+     */
+    void writeFiles(const vector<string> &paths, const std::function<void(size_t, vector<std::byte> &)> &produce);
+};
+
+#endif    // ELPOPS_ASYNCIO_HPP
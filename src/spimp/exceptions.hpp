@@ -32,6 +32,32 @@ namespace errors
         const string &getPath() const { return path; }
     };
 
+    class IOError : public std::runtime_error {
+        string path;
+
+      public:
+        IOError(const string &path, const string &msg)
+            : std::runtime_error(format("i/o error: %s: '%s'", msg.c_str(), path.c_str())), path(path) {}
+
+        const string &getPath() const { return path; }
+    };
+
+    class BytecodeError : public std::runtime_error {
+      public:
+        explicit BytecodeError(const string &msg)
+            : std::runtime_error(format("invalid bytecode: %s", msg.c_str())) {}
+    };
+
+    class AssemblyError : public std::runtime_error {
+        uint32 line;
+
+      public:
+        AssemblyError(uint32 line, const string &msg)
+            : std::runtime_error(format("assembly error: line %u: %s", line, msg.c_str())), line(line) {}
+
+        uint32 getLine() const { return line; }
+    };
+
     class SignatureError : public std::runtime_error {
       public:
         SignatureError(string sign, string msg)
@@ -0,0 +1,126 @@
+#include "filemap.hpp"
+#include "exceptions.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#    define SPUTILS_HAS_MMAP
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+FileMap::FileMap(const string &path) {
+#ifdef SPUTILS_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw errors::FileNotFoundError(path);
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw errors::FileNotFoundError(path);
+    }
+    size = st.st_size;
+    if (size > 0) {
+        void *addr = mmap(null, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (addr == MAP_FAILED) throw errors::FileNotFoundError(path);
+        data = static_cast<uint8 *>(addr);
+        mapped = true;
+    } else {
+        ::close(fd);
+    }
+#else
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == null) throw errors::FileNotFoundError(path);
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = new uint8[size];
+    if (fread(data, 1, size, file) != size) {
+        fclose(file);
+        delete[] data;
+        throw errors::CorruptFileError(path);
+    }
+    fclose(file);
+#endif
+    open = true;
+}
+
+FileMap::FileMap(FileMap &&other) noexcept
+    : data(other.data), size(other.size), open(other.open), mapped(other.mapped) {
+    other.data = null;
+    other.size = 0;
+    other.open = false;
+    other.mapped = false;
+}
+
+FileMap &FileMap::operator=(FileMap &&other) noexcept {
+    if (this != &other) {
+        close();
+        data = other.data;
+        size = other.size;
+        open = other.open;
+        mapped = other.mapped;
+        other.data = null;
+        other.size = 0;
+        other.open = false;
+        other.mapped = false;
+    }
+    return *this;
+}
+
+FileMap::~FileMap() {
+    close();
+}
+
+void FileMap::close() {
+#ifdef SPUTILS_HAS_MMAP
+    if (mapped) munmap(data, size);
+#else
+    delete[] data;
+#endif
+    data = null;
+    size = 0;
+    open = false;
+    mapped = false;
+}
+
+size_t readFileHead(const string &path, vector<std::byte> &dest, size_t count) {
+#ifdef SPUTILS_HAS_MMAP
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw errors::FileNotFoundError(path);
+    struct stat st {};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw errors::FileNotFoundError(path);
+    }
+    size_t fileSize = st.st_size;
+    dest.resize(std::min(count, fileSize));
+    size_t done = 0;
+    while (done < dest.size()) {
+        ssize_t result = pread(fd, dest.data() + done, dest.size() - done, done);
+        if (result < 0 && errno == EINTR) continue;
+        if (result <= 0) {
+            string msg = result < 0 ? strerror(errno) : "file ended early";
+            ::close(fd);
+            throw errors::IOError(path, msg);
+        }
+        done += result;
+    }
+    ::close(fd);
+    return fileSize;
+#else
+    FILE *file = fopen(path.c_str(), "rb");
+    if (file == null) throw errors::FileNotFoundError(path);
+    fseek(file, 0, SEEK_END);
+    size_t fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    dest.resize(std::min(count, fileSize));
+    size_t done = fread(dest.data(), 1, dest.size(), file);
+    fclose(file);
+    if (done != dest.size()) throw errors::IOError(path, "cannot read file");
+    return fileSize;
+#endif
+}
@@ -0,0 +1,62 @@
+#ifndef ELPOPS_FILEMAP_HPP
+#define ELPOPS_FILEMAP_HPP
+
+#include "common.hpp"
+
+/**
+ * Maps a whole file into memory.
+ * The mapping is private and copy-on-write, so the mapped bytes can be freely
+ * modified without touching the file on disk. On platforms without mmap
+ * the file contents are read into a heap buffer instead
+ */
+class FileMap {
+  private:
+    uint8 *data = null;
+    size_t size = 0;
+    bool open = false;
+    bool mapped = false;
+
+  public:
+    FileMap() = default;
+
+    /**
+     * Maps the file at path into memory
+     * @throws errors::FileNotFoundError if the file cannot be opened
+     */
+    explicit FileMap(const string &path);
+
+    FileMap(const FileMap &) = delete;
+
+    FileMap(FileMap &&other) noexcept;
+
+    FileMap &operator=(const FileMap &) = delete;
+
+    FileMap &operator=(FileMap &&other) noexcept;
+
+    ~FileMap();
+
+    /**
+     * Unmaps the file, all pointers into the mapping become invalid
+     */
+    void close();
+
+    bool isOpen() const { return open; }
+
+    uint8 *getData() const { return data; }
+
+    size_t getSize() const { return size; }
+};
+
+/**
+ * Reads up to count bytes from the start of the file at path with a single
+ * positioned read, without going through stdio buffering
+ * @param path the path of the file
+ * @param dest the buffer, resized to the number of bytes read
+ * @param count the number of bytes to read
+ * @return the size of the whole file
+ * @throws errors::FileNotFoundError if the file cannot be opened
+ * @throws errors::IOError if fewer than the requested bytes can be read, for example from a directory
+ */
+size_t readFileHead(const string &path, vector<std::byte> &dest, size_t count);
+
+#endif    // ELPOPS_FILEMAP_HPP
@@ -0,0 +1,122 @@
+#include "lz.hpp"
+#include "utils.hpp"
+#include <algorithm>
+
+static constexpr size_t MIN_MATCH = 4;
+static constexpr size_t MAX_OFFSET = 65535;
+static constexpr int HASH_BITS = 14;
+
+static inline uint32 load32(const uint8 *bytes) {
+    uint32 value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static inline uint32 hash(uint32 sequence) {
+    return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static uint8 *writeLength(uint8 *op, size_t length) {
+    for (; length >= 255; length -= 255) *op++ = 255;
+    *op++ = static_cast<uint8>(length);
+    return op;
+}
+
+static bool readLength(const uint8 *&ip, const uint8 *ipEnd, size_t &length) {
+    uint8 byte;
+    do {
+        if (ip == ipEnd) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+/**
+ * Writes a sequence, without a match if matchLength is 0
+ */
+static uint8 *writeSequence(uint8 *op, const uint8 *literals, size_t literalCount, size_t offset, size_t matchLength) {
+    uint8 *token = op++;
+    size_t matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    *token = static_cast<uint8>(std::min<size_t>(literalCount, 15) << 4 | std::min<size_t>(matchCode, 15));
+    if (literalCount >= 15) op = writeLength(op, literalCount - 15);
+    if (literalCount > 0) memcpy(op, literals, literalCount);
+    op += literalCount;
+    if (matchLength == 0) return op;
+    storeBigEndian(op, static_cast<uint16>(offset));
+    op += 2;
+    if (matchCode >= 15) op = writeLength(op, matchCode - 15);
+    return op;
+}
+
+size_t lzCompress(const uint8 *src, size_t size, uint8 *dest) {
+    if (size > UINT32_MAX) throw std::length_error("lzCompress(): block exceeds 4 GiB");
+    // Positions of the last sequence seen with each hash. Stale or colliding
+    // entries are harmless as every candidate is compared before it is used
+    vector<uint32> table(1 << HASH_BITS);
+    const uint8 *ip = src;
+    const uint8 *anchor = src;
+    const uint8 *end = src + size;
+    uint8 *op = dest;
+    if (size >= MIN_MATCH) {
+        const uint8 *limit = end - MIN_MATCH;
+        // Incompressible input is skipped over faster the longer no match is found
+        size_t misses = 0;
+        while (ip <= limit) {
+            uint32 sequence = load32(ip);
+            uint32 &slot = table[hash(sequence)];
+            const uint8 *ref = src + slot;
+            slot = static_cast<uint32>(ip - src);
+            if (ref >= ip || static_cast<size_t>(ip - ref) > MAX_OFFSET || load32(ref) != sequence) {
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+            misses = 0;
+            while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uint8 *matchEnd = ip + MIN_MATCH;
+            while (matchEnd < end && *matchEnd == ref[matchEnd - ip]) matchEnd++;
+            op = writeSequence(op, anchor, ip - anchor, ip - ref, matchEnd - ip);
+            ip = anchor = matchEnd;
+            if (ip <= limit) table[hash(load32(ip - 2))] = static_cast<uint32>(ip - 2 - src);
+        }
+    }
+    op = writeSequence(op, anchor, end - anchor, 0, 0);
+    return op - dest;
+}
+
+bool lzDecompress(const uint8 *src, size_t size, uint8 *dest, size_t destSize) {
+    const uint8 *ip = src;
+    const uint8 *ipEnd = src + size;
+    uint8 *op = dest;
+    uint8 *opEnd = dest + destSize;
+    while (ip < ipEnd) {
+        uint8 token = *ip++;
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !readLength(ip, ipEnd, literalCount)) return false;
+        if (literalCount > static_cast<size_t>(ipEnd - ip) || literalCount > static_cast<size_t>(opEnd - op)) return false;
+        if (literalCount > 0) memcpy(op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+        if (ip == ipEnd) break;
+
+        if (ipEnd - ip < 2) return false;
+        size_t offset = loadBigEndian<uint16>(ip);
+        ip += 2;
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, ipEnd, matchLength)) return false;
+        matchLength += MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(op - dest) || matchLength > static_cast<size_t>(opEnd - op)) return false;
+        const uint8 *match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+        } else {
+            // The match overlaps the bytes it produces, which repeats its first offset bytes
+            for (size_t i = 0; i < matchLength; ++i) op[i] = match[i];
+        }
+        op += matchLength;
+    }
+    return op == opEnd;
+}
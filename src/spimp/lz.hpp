@@ -0,0 +1,49 @@
+#ifndef ELPOPS_LZ_HPP
+#define ELPOPS_LZ_HPP
+
+#include "common.hpp"
+
+/**
+ * A small LZ77 block codec built for decompression speed.
+ * A block is a list of sequences, each of them a run of literals followed by a
+ * match that copies bytes from earlier in the output. The last sequence has no match.
+ * <br>
+ * Layout of a sequence :-
+ * <pre>
+ * ui1 token                   (literal count << 4 | match length - 4, 15 in either means more follows)
+ * ui1 literalCount[]          (only if the count in the token is 15, bytes of 255 end by one below 255)
+ * ui1 literals[]
+ * ui2 offset                  (big endian distance back to the match, 1 to 65535)
+ * ui1 matchLength[]           (only if the length in the token is 15, like literalCount)
+ * </pre>
+ */
+
+/**
+ * @return the largest size lzCompress() produces for size bytes
+ */
+constexpr size_t lzBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+/**
+ * Compresses a block
+ * @param src the bytes to compress, at most 4 GiB
+ * @param size number of bytes
+ * @param dest the output, at least lzBound(size) bytes long
+ * @return the number of bytes written to dest
+ * @throws std::length_error if the block is too large
+ */
+size_t lzCompress(const uint8 *src, size_t size, uint8 *dest);
+
+/**
+ * Decompresses a block written by lzCompress(). The input is validated, so a corrupt
+ * block never makes this read or write out of bounds
+ * @param src the compressed block
+ * @param size size of the compressed block
+ * @param dest the output
+ * @param destSize the exact size of the decompressed block
+ * @return whether the block was valid and decompressed to exactly destSize bytes
+ */
+bool lzDecompress(const uint8 *src, size_t size, uint8 *dest, size_t destSize);
+
+#endif    // ELPOPS_LZ_HPP
@@ -0,0 +1,56 @@
+#ifndef ELPOPS_PARALLEL_HPP
+#define ELPOPS_PARALLEL_HPP
+
+#include "common.hpp"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+/**
+ * @param threads the requested number of threads, 0 for one per hardware thread
+ * @return the number of worker threads to use for count tasks
+ */
+inline size_t workerCount(size_t threads, size_t count) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(threads, count));
+}
+
+/**
+ * Runs fn(index, worker) for every index in [0, count) on a pool of worker threads.
+ * Tasks are handed out in index order. worker is in [0, workerCount(threads, count))
+ * and identifies the thread running the task, so it can be used to pick per thread state.
+ * If a task throws, no more tasks are started and the first exception is rethrown
+ * @param count number of tasks
+ * @param threads number of threads, 0 for one per hardware thread
+ * @param fn the task
+ */
+template<typename F>
+void parallelFor(size_t count, size_t threads, F &&fn) {
+    size_t workers = workerCount(threads, count);
+    if (workers == 1) {
+        for (size_t i = 0; i < count; ++i) fn(i, size_t(0));
+        return;
+    }
+    std::atomic<size_t> next = 0;
+    std::atomic<bool> failed = false;
+    std::exception_ptr error;
+    std::mutex errorLock;
+    auto work = [&](size_t worker) {
+        try {
+            for (size_t i = next++; i < count && !failed; i = next++) fn(i, worker);
+        } catch (...) {
+            std::lock_guard guard{errorLock};
+            if (!failed.exchange(true)) error = std::current_exception();
+        }
+    };
+    vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (size_t worker = 1; worker < workers; ++worker) pool.emplace_back(work, worker);
+    work(0);
+    for (auto &thread: pool) thread.join();
+    if (error) std::rethrow_exception(error);
+}
+
+#endif    // ELPOPS_PARALLEL_HPP
@@ -0,0 +1,23 @@
+#include "stringtable.hpp"
+
+uint8 *StringTable::intern(const uint8 *bytes, size_t len) {
+    std::string_view key{reinterpret_cast<const char *>(bytes), len};
+    Shard &shard = shards[std::hash<std::string_view>{}(key) % SHARD_COUNT];
+    std::lock_guard guard{shard.lock};
+    auto it = shard.strings.find(key);
+    if (it == shard.strings.end()) {
+        auto copy = shard.arena.alloc<char>(len);
+        memcpy(copy, bytes, len);
+        it = shard.strings.insert(std::string_view{copy, len}).first;
+    }
+    return reinterpret_cast<uint8 *>(const_cast<char *>(it->data()));
+}
+
+size_t StringTable::size() {
+    size_t count = 0;
+    for (auto &shard: shards) {
+        std::lock_guard guard{shard.lock};
+        count += shard.strings.size();
+    }
+    return count;
+}
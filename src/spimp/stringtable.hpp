@@ -0,0 +1,51 @@
+#ifndef ELPOPS_STRINGTABLE_HPP
+#define ELPOPS_STRINGTABLE_HPP
+
+#include "arena.hpp"
+#include "common.hpp"
+#include <array>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+/**
+ * A thread safe table of interned byte strings.
+ * Equal strings are stored once and every caller interning them gets the same
+ * pointer. The table is split into independently locked shards to keep
+ * contention low when many threads intern at once
+ */
+class StringTable {
+  private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Shard {
+        std::mutex lock;
+        std::unordered_set<std::string_view> strings;
+        Arena arena{16 * 1024};
+    };
+
+    std::array<Shard, SHARD_COUNT> shards;
+
+  public:
+    StringTable() = default;
+
+    StringTable(const StringTable &) = delete;
+
+    StringTable &operator=(const StringTable &) = delete;
+
+    /**
+     * Interns a byte string. The returned bytes are shared by everyone who
+     * interned an equal string and must not be modified
+     * @param bytes the string
+     * @param len length of the string
+     * @return the interned copy of the string, valid for the lifetime of the table
+     */
+    uint8 *intern(const uint8 *bytes, size_t len);
+
+    /**
+     * @return the number of distinct strings in the table
+     */
+    size_t size();
+};
+
+#endif    // ELPOPS_STRINGTABLE_HPP
@@ -2,11 +2,49 @@
 #define ELPOPS_UTILS_HPP
 
 #include "common.hpp"
+#include <bit>
 
 uint64 doubleToRaw(double number);
 
 uint64 signedToUnsigned(int64 number);
 
+/**
+ * Reverses the byte order of an unsigned integer
+ */
+template<typename T>
+inline T byteSwap(T value) {
+    if constexpr (sizeof(T) == 1) {
+        return value;
+    } else if constexpr (sizeof(T) == 2) {
+        return __builtin_bswap16(value);
+    } else if constexpr (sizeof(T) == 4) {
+        return __builtin_bswap32(value);
+    } else {
+        static_assert(sizeof(T) == 8, "byteSwap(): unsupported size");
+        return __builtin_bswap64(value);
+    }
+}
+
+/**
+ * Loads a big endian unsigned integer from possibly unaligned memory
+ */
+template<typename T>
+inline T loadBigEndian(const uint8 *bytes) {
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    if constexpr (std::endian::native == std::endian::little) value = byteSwap(value);
+    return value;
+}
+
+/**
+ * Stores an unsigned integer in big endian order to possibly unaligned memory
+ */
+template<typename T>
+inline void storeBigEndian(uint8 *bytes, T value) {
+    if constexpr (std::endian::native == std::endian::little) value = byteSwap(value);
+    memcpy(bytes, &value, sizeof(T));
+}
+
 template<typename T>
 static vector<T> slice(vector<T> list, int64 start, int64 end) {
     if (start < 0) start += list.size();
@@ -22,7 +60,7 @@ static vector<T> slice(vector<T> list, int64 start, int64 end) {
     return result;
 }
 
-string join(const vector<string> list, string delimiter) {
+inline string join(const vector<string> list, string delimiter) {
     string text = "";
     for (int i = 0; i < list.size(); ++i) {
         text += list[i];
@@ -0,0 +1,20 @@
+#include "bytecode.hpp"
+#include "../spimp/exceptions.hpp"
+
+Bytecode::Bytecode(const uint8 *code, uint32 count) : code(code), count(count) {
+    for (uint32 pc = 0; pc < count;) {
+        uint8 opcode = code[pc];
+        if (opcode >= static_cast<uint8>(Opcode::NUM_OPCODES)) {
+            throw errors::BytecodeError(format("unknown opcode 0x%02x at %u", opcode, pc));
+        }
+        size_t length;
+        if (static_cast<Opcode>(opcode) == Opcode::CLOSURELOAD) {
+            if (count - pc < 2) throw errors::BytecodeError(format("truncated instruction at %u", pc));
+            length = 2 + 2 * code[pc + 1];
+        } else {
+            length = 1 + OpcodeInfo::getParams(static_cast<Opcode>(opcode));
+        }
+        if (count - pc < length) throw errors::BytecodeError(format("truncated instruction at %u", pc));
+        pc += length;
+    }
+}
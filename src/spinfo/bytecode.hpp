@@ -0,0 +1,141 @@
+#ifndef VELOCITY_BYTECODE_HPP
+#define VELOCITY_BYTECODE_HPP
+
+#include "../spimp/common.hpp"
+#include "../spimp/utils.hpp"
+#include "opcode.hpp"
+#include <iterator>
+
+/**
+ * A decoded instruction
+ */
+struct Instruction {
+    /// Offset of the opcode in the code array
+    uint32 pc;
+    Opcode opcode;
+    /// Size of the instruction in bytes, the opcode included
+    uint32 length;
+    /// The one or two byte big endian param, the count of params for CLOSURELOAD, 0 if there is none
+    uint32 operand;
+    /// Whether operand is an index into the constant pool
+    bool isConstPoolRef;
+    /// The bytes following the opcode
+    const uint8 *params;
+
+    /**
+     * @param index index of the param, less than operand
+     * @return a two byte param of CLOSURELOAD
+     */
+    uint16 getClosureParam(size_t index) const {
+        return loadBigEndian<uint16>(params + 1 + 2 * index);
+    }
+
+    /**
+     * @return the pc a jump lands on, see OpcodeInfo::isJump(), negative if it leaves the code array backwards
+     */
+    int64 getJumpTarget() const {
+        int64 next = static_cast<int64>(pc) + length;
+        return opcode == Opcode::JBW ? next - operand : next + operand;
+    }
+};
+
+/**
+ * A code array whose instructions can be iterated over without any allocation.
+ * The whole array is validated once when the view is created, so decoding the
+ * instructions afterwards needs no bounds checks.
+ * <br>
+ * An instruction is an opcode followed by OpcodeInfo::getParams() bytes of params,
+ * a two byte param being big endian. CLOSURELOAD is followed by a one byte count
+ * and that many two byte params instead
+ */
+class Bytecode {
+  public:
+    class Iterator {
+      private:
+        const uint8 *code = null;
+        uint32 count = 0;
+        Instruction current{};
+
+        void moveTo(uint32 pc) {
+            if (pc < count) {
+                current = decode(code, pc);
+            } else {
+                current.pc = pc;
+            }
+        }
+
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Instruction;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Instruction *;
+        using reference = const Instruction &;
+
+        Iterator() = default;
+
+        Iterator(const uint8 *code, uint32 pc, uint32 count) : code(code), count(count) { moveTo(pc); }
+
+        reference operator*() const { return current; }
+
+        pointer operator->() const { return &current; }
+
+        Iterator &operator++() {
+            moveTo(current.pc + current.length);
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const Iterator &other) const { return current.pc == other.current.pc; }
+    };
+
+  private:
+    const uint8 *code;
+    uint32 count;
+
+  public:
+    /**
+     * Validates a code array
+     * @param code the code array, must outlive this object
+     * @param count size of the code array
+     * @throws errors::BytecodeError if an opcode is unknown or an instruction is truncated
+     */
+    Bytecode(const uint8 *code, uint32 count);
+
+    /**
+     * Decodes the instruction at pc without any checks
+     * @param code a code array validated by Bytecode
+     * @param pc offset of an opcode in the code array
+     * @return the instruction
+     */
+    static Instruction decode(const uint8 *code, uint32 pc) {
+        Instruction instruction{};
+        instruction.pc = pc;
+        instruction.opcode = static_cast<Opcode>(code[pc]);
+        instruction.params = code + pc + 1;
+        if (instruction.opcode == Opcode::CLOSURELOAD) {
+            instruction.operand = instruction.params[0];
+            instruction.length = 2 + 2 * instruction.operand;
+            return instruction;
+        }
+        uint8 params = OpcodeInfo::getParams(instruction.opcode);
+        instruction.length = 1 + params;
+        if (params == 1) {
+            instruction.operand = instruction.params[0];
+        } else if (params == 2) {
+            instruction.operand = loadBigEndian<uint16>(instruction.params);
+        }
+        instruction.isConstPoolRef = params != 0 && OpcodeInfo::takeFromConstPool(instruction.opcode);
+        return instruction;
+    }
+
+    Iterator begin() const { return {code, 0, count}; }
+
+    Iterator end() const { return {code, count, count}; }
+};
+
+#endif    // VELOCITY_BYTECODE_HPP
@@ -2,6 +2,8 @@
 #define VELOCITY_OPCODE_HPP
 
 #include "../spimp/common.hpp"
+#include <iterator>
+#include <string_view>
 
 /**
  * Enum containing all opcodes of the bytecode language
@@ -269,7 +271,7 @@ enum class Opcode {
     MTPERF,
     /// perform match fast
     MTFPERF,
-    /// load closure
+    /// load closure, followed by a one byte count and that many two byte operands
     CLOSURELOAD,
     /// load reified object
     REIFIEDLOAD,
@@ -284,9 +286,235 @@ enum class Opcode {
 
     // Debug op
     PRINTLN,
+
+    /// return with a one byte operand, numbered after PRINTLN so the existing opcodes keep their values
+    NRET,
     NUM_OPCODES
 };
 
+/**
+ * Name and params of an opcode
+ */
+struct OpcodeEntry {
+    std::string_view name;
+    /// Number of bytes of params following the opcode, -1 if it varies
+    int params;
+    /// Whether the param refers to the constant pool
+    bool take;
+};
+
+/// Indexed by Opcode
+inline constexpr OpcodeEntry OPCODE_TABLE[] = {
+        {"nop",          0,  false},
+
+        {"const",        1,  true },
+        {"constl",       2,  true },
+        {"pop",          0,  false},
+        {"npop",         1,  false},
+        {"dup",          0,  false},
+        {"ndup",         1,  false},
+
+        {"gload",        2,  true },
+        {"gfload",       1,  true },
+        {"gstore",       2,  true },
+        {"gfstore",      1,  true },
+        {"pgstore",      2,  true },
+        {"pgfstore",     1,  true },
+        {"lload",        2,  false},
+        {"lfload",       1,  false},
+        {"lstore",       2,  false},
+        {"lfstore",      1,  false},
+        {"plstore",      2,  false},
+        {"plfstore",     1,  false},
+        {"aload",        1,  false},
+        {"astore",       1,  false},
+        {"pastore",      1,  false},
+        {"tload",        2,  true },
+        {"tfload",       1,  true },
+        {"tstore",       2,  true },
+        {"tfstore",      1,  true },
+        {"ptstore",      2,  true },
+        {"ptfstore",     1,  true },
+        {"mload",        2,  true },
+        {"mfload",       1,  true },
+        {"mstore",       2,  true },
+        {"mfstore",      1,  true },
+        {"pmstore",      2,  true },
+        {"pmfstore",     1,  true },
+        {"sload",        2,  true },
+        {"sfload",       1,  true },
+        {"sstore",       2,  true },
+        {"sfstore",      1,  true },
+        {"psstore",      2,  true },
+        {"psfstore",     1,  true },
+        {"spload",       2,  true },
+        {"spfload",      1,  true },
+        {"bload",        2,  false},
+        {"bfload",       1,  false},
+
+        {"arrpack",      0,  false},
+        {"arrunpack",    0,  false},
+        {"arrbuild",     2,  false},
+        {"arrfbuild",    1,  false},
+        {"iload",        0,  false},
+        {"istore",       0,  false},
+        {"pistore",      0,  false},
+        {"arrlen",       0,  false},
+
+        {"invoke",       1,  false},
+        {"vinvoke",      2,  true },
+        {"sinvoke",      2,  true },
+        {"spinvoke",     2,  true },
+        {"linvoke",      2,  false},
+        {"ginvoke",      2,  true },
+        {"ainvoke",      1,  false},
+        {"vfinvoke",     1,  true },
+        {"sfinvoke",     1,  true },
+        {"spfinvoke",    1,  true },
+        {"lfinvoke",     1,  false},
+        {"gfinvoke",     1,  true },
+
+        {"callsub",      0,  false},
+        {"retsub",       0,  false},
+
+        {"jfw",          2,  false},
+        {"jbw",          2,  false},
+        {"jt",           2,  false},
+        {"jf",           2,  false},
+        {"jlt",          2,  false},
+        {"jle",          2,  false},
+        {"jeq",          2,  false},
+        {"jne",          2,  false},
+        {"jge",          2,  false},
+        {"jgt",          2,  false},
+
+        {"not",          0,  false},
+        {"inv",          0,  false},
+        {"neg",          0,  false},
+        {"gettype",      0,  false},
+        {"scast",        0,  false},
+        {"ccast",        0,  false},
+        {"pow",          0,  false},
+        {"mul",          0,  false},
+        {"div",          0,  false},
+        {"rem",          0,  false},
+        {"add",          0,  false},
+        {"sub",          0,  false},
+        {"shl",          0,  false},
+        {"shr",          0,  false},
+        {"ushr",         0,  false},
+        {"and",          0,  false},
+        {"or",           0,  false},
+        {"xor",          0,  false},
+        {"lt",           0,  false},
+        {"le",           0,  false},
+        {"eq",           0,  false},
+        {"ne",           0,  false},
+        {"ge",           0,  false},
+        {"gt",           0,  false},
+        {"is",           0,  false},
+        {"nis",          0,  false},
+        {"isnull",       0,  false},
+        {"nisnull",      0,  false},
+
+        {"i2f",          0,  false},
+        {"f2i",          0,  false},
+        {"i2b",          0,  false},
+        {"b2i",          0,  false},
+        {"o2b",          0,  false},
+        {"o2s",          0,  false},
+
+        {"entermonitor", 0,  false},
+        {"exitmonitor",  0,  false},
+
+        {"mtperf",       2,  false},
+        {"mtfperf",      1,  false},
+        {"closureload",  -1, false},
+        {"reifiedload",  1,  false},
+        {"objload",      0,  false},
+
+        {"throw",        0,  false},
+        {"ret",          0,  false},
+        {"vret",         0,  false},
+
+        {"println",      0,  false},
+
+        {"nret",         1,  false},
+};
+
+static_assert(static_cast<size_t>(Opcode::NUM_OPCODES) == std::size(OPCODE_TABLE), "update opcode table");
+
+/**
+ * Hashes an opcode name, the seed picks one of a family of hash functions
+ */
+constexpr uint32 opcodeNameHash(std::string_view name, uint32 seed) {
+    uint32 hash = 2166136261u ^ (seed * 0x9E3779B1u);
+    for (char c: name) hash = (hash ^ static_cast<uint8>(c)) * 16777619u;
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    hash ^= hash >> 12;
+    return hash;
+}
+
+/**
+ * Perfect hash of the opcode names. A name hashes with seed 0 to its bucket, then
+ * with the displacement of the bucket as seed to its slot. The displacements are
+ * picked at compile time so that no two names share a slot
+ */
+struct OpcodeNameHash {
+    static constexpr size_t BUCKETS = 64;
+    static constexpr size_t SLOTS = 256;
+
+    uint16 displacements[BUCKETS];
+    /// The opcode of the name in each slot plus one, 0 if the slot is empty
+    uint8 slots[SLOTS];
+};
+
+/**
+ * Builds the perfect hash of the opcode names, largest buckets first, by trying
+ * displacements until every name of a bucket lands in a free slot
+ */
+constexpr OpcodeNameHash buildOpcodeNameHash() {
+    constexpr size_t count = std::size(OPCODE_TABLE);
+    static_assert(count < OpcodeNameHash::SLOTS, "opcodes do not fit in the name hash");
+    OpcodeNameHash table{};
+    size_t buckets[count]{};
+    size_t sizes[OpcodeNameHash::BUCKETS]{};
+    for (size_t i = 0; i < count; ++i) {
+        buckets[i] = opcodeNameHash(OPCODE_TABLE[i].name, 0) % OpcodeNameHash::BUCKETS;
+        sizes[buckets[i]]++;
+    }
+    for (size_t size = count; size > 0; --size) {
+        for (size_t bucket = 0; bucket < OpcodeNameHash::BUCKETS; ++bucket) {
+            if (sizes[bucket] != size) continue;
+            for (uint32 displacement = 1;; ++displacement) {
+                if (displacement > UINT16_MAX) throw std::logic_error("opcode names are not unique");
+                size_t placed[count]{};
+                size_t placedCount = 0;
+                bool fits = true;
+                for (size_t i = 0; i < count && fits; ++i) {
+                    if (buckets[i] != bucket) continue;
+                    size_t slot = opcodeNameHash(OPCODE_TABLE[i].name, displacement) % OpcodeNameHash::SLOTS;
+                    if (table.slots[slot] != 0) {
+                        fits = false;
+                    } else {
+                        table.slots[slot] = static_cast<uint8>(i + 1);
+                        placed[placedCount++] = slot;
+                    }
+                }
+                if (fits) {
+                    table.displacements[bucket] = static_cast<uint16>(displacement);
+                    break;
+                }
+                for (size_t i = 0; i < placedCount; ++i) table.slots[placed[i]] = 0;
+            }
+        }
+    }
+    return table;
+}
+
+inline constexpr OpcodeNameHash OPCODE_NAME_HASH = buildOpcodeNameHash();
+
 /**
  * Contains debug info for all opcodes
  */
@@ -296,25 +524,48 @@ class OpcodeInfo {
      * @param opcode
      * @return string representation of the opcode
      */
-    static string toString(Opcode opcode);
+    static constexpr std::string_view toString(Opcode opcode) {
+        return OPCODE_TABLE[static_cast<size_t>(opcode)].name;
+    }
 
     /**
      * @param opcode
-     * @return number of params needed for the opcode
+     * @return number of bytes of params following the opcode, 255 for CLOSURELOAD
+     * whose params are variable in length (see Bytecode)
      */
-    static uint8 getParams(Opcode opcode);
+    static constexpr uint8 getParams(Opcode opcode) {
+        return static_cast<uint8>(OPCODE_TABLE[static_cast<size_t>(opcode)].params);
+    }
 
     /**
      * @param opcode
      * @return whether the param of the opcode refers to the constant pool
      */
-    static bool takeFromConstPool(Opcode opcode);
+    static constexpr bool takeFromConstPool(Opcode opcode) {
+        return OPCODE_TABLE[static_cast<size_t>(opcode)].take;
+    }
+
+    /**
+     * @param opcode
+     * @return whether the opcode is one of JFW to JGT, whose two byte param is the distance
+     * from the end of the instruction to the target, backwards for JBW and forwards otherwise
+     */
+    static constexpr bool isJump(Opcode opcode) {
+        return opcode >= Opcode::JFW && opcode <= Opcode::JGT;
+    }
 
     /**
+     * Looks the name up in OPCODE_NAME_HASH, hashing it twice and comparing it once
      * @param str
      * @return the opcode associated with str, Opcode::NOP otherwise
      */
-    static Opcode fromString(string str);
+    static constexpr Opcode fromString(std::string_view str) {
+        size_t bucket = opcodeNameHash(str, 0) % OpcodeNameHash::BUCKETS;
+        size_t slot = opcodeNameHash(str, OPCODE_NAME_HASH.displacements[bucket]) % OpcodeNameHash::SLOTS;
+        uint8 entry = OPCODE_NAME_HASH.slots[slot];
+        if (entry != 0 && OPCODE_TABLE[entry - 1].name == str) return static_cast<Opcode>(entry - 1);
+        return Opcode::NOP;
+    }
 };
 
 #endif    // VELOCITY_OPCODE_HPP
@@ -3,19 +3,38 @@
 
 // Important header files
 
+#include "spimp/arena.hpp"
+#include "spimp/asyncio.hpp"
 #include "spimp/common.hpp"
 #include "spimp/exceptions.hpp"
+#include "spimp/filemap.hpp"
 #include "spimp/format.hpp"
+#include "spimp/lz.hpp"
+#include "spimp/parallel.hpp"
+#include "spimp/stringtable.hpp"
 #include "spimp/utils.hpp"
 
 // Header files related to elp operations
 
+#include "elpops/assembler.hpp"
+#include "elpops/batch.hpp"
+#include "elpops/compact.hpp"
+#include "elpops/compress.hpp"
+#include "elpops/decoded.hpp"
+#include "elpops/disassembler.hpp"
 #include "elpops/elpdef.hpp"
+#include "elpops/encoder.hpp"
+#include "elpops/flat.hpp"
+#include "elpops/image.hpp"
+#include "elpops/module.hpp"
+#include "elpops/patch.hpp"
 #include "elpops/reader.hpp"
+#include "elpops/visitor.hpp"
 #include "elpops/writer.hpp"
 
 // Header files related to other information
 
+#include "spinfo/bytecode.hpp"
 #include "spinfo/opcode.hpp"
 #include "spinfo/sign.hpp"
 
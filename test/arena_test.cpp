@@ -0,0 +1,51 @@
+#include "test.hpp"
+
+/// Marking, filling past the current chunk and rewinding must not grow the arena each time
+static void testRewindReusesChunks() {
+    Arena arena;
+    for (int i = 0; i < 1000; ++i) {
+        auto mark = arena.mark();
+        auto bytes = arena.alloc<uint8>(100000);
+        bytes[99999] = 1;
+        arena.rewind(mark);
+    }
+    auto outer = arena.mark();
+    arena.alloc<uint8>(1000);
+    for (int i = 0; i < 1000; ++i) {
+        auto mark = arena.mark();
+        arena.alloc<uint8>(1 << 20);
+        arena.alloc<uint8>(10);
+        arena.rewind(mark);
+    }
+    arena.rewind(outer);
+}
+
+static void testRewindKeepsEarlierAllocations() {
+    Arena arena{4096};
+    auto first = arena.alloc<uint32>(100);
+    for (int i = 0; i < 100; ++i) first[i] = i;
+    auto mark = arena.mark();
+    for (int i = 0; i < 10; ++i) arena.alloc<uint8>(50000);
+    arena.rewind(mark);
+    auto second = arena.alloc<uint32>(100000);
+    second[99999] = 7;
+    for (int i = 0; i < 100; ++i) CHECK(first[i] == uint32(i));
+}
+
+static void testMove() {
+    Arena arena;
+    auto mark = arena.mark();
+    arena.alloc<uint8>(200000);
+    arena.rewind(mark);
+    Arena moved = std::move(arena);
+    moved.alloc<uint8>(100000);
+    arena = std::move(moved);
+    arena.alloc<uint8>(10);
+}
+
+int main() {
+    testRewindReusesChunks();
+    testRewindKeepsEarlierAllocations();
+    testMove();
+    puts("ok");
+}
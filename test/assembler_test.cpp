@@ -0,0 +1,117 @@
+#include "test.hpp"
+
+static const char *PROGRAM = R"(
+.magic 0xC0FFEEDE
+.version 1 2
+.module my::module
+.source "main.sp"
+.entry my::module.main()
+.global my::module.x my::Int 3
+.method my::module.main()
+    .flags 0x0001
+    .arg a my::Int
+    .local i my::Int
+start:
+    const 42
+    const "text"
+    jt done         ; forward, fixed up at .end
+    jfw middle
+    aload 0
+middle:
+    closureload 1 2 0x10
+    jbw start       ; backward, encoded right away
+    jf start2
+    const 42        ; interned again
+start2:
+    jbw middle
+done:
+    ret
+    .catch start done done my::Err
+    .method my::module.main().lambda
+    loop:
+        jbw loop
+        vret
+    .end
+.end
+)";
+
+/// @return the instructions of a method in order
+static vector<Instruction> instructions(const MethodInfo &method) {
+    vector<Instruction> result;
+    for (const Instruction &instruction: Bytecode(method.code, method.codeCount)) result.push_back(instruction);
+    return result;
+}
+
+static void testJumps() {
+    Assembler assembler;
+    ElpModule module = assembler.assemble(PROGRAM);
+    const ElpInfo &elp = module.getInfo();
+    CHECK(elp.magic == 0xC0FFEEDE && elp.majorVersion == 1 && elp.minorVersion == 2);
+    CHECK(elp.objectsCount == 1 && elp.globalsCount == 1);
+    const MethodInfo &method = elp.objects[0]._method;
+    auto code = instructions(method);
+    CHECK(code.size() == 11);
+    // The labels are start at instruction 0, middle at 5, start2 at 9 and done at 10
+    auto pcOf = [&](size_t index) { return code[index].pc; };
+    CHECK(code[2].opcode == Opcode::JT && code[2].getJumpTarget() == pcOf(10));
+    CHECK(code[3].opcode == Opcode::JFW && code[3].getJumpTarget() == pcOf(5));
+    CHECK(code[6].opcode == Opcode::JBW && code[6].getJumpTarget() == pcOf(0));
+    CHECK(code[7].opcode == Opcode::JF && code[7].getJumpTarget() == pcOf(9));
+    CHECK(code[9].opcode == Opcode::JBW && code[9].getJumpTarget() == pcOf(5));
+    // Equal constants share an entry
+    CHECK(code[0].operand == code[8].operand);
+    CHECK(method.exceptionTableCount == 1);
+    CHECK(method.exceptionTable[0].startPc == pcOf(0) && method.exceptionTable[0].endPc == pcOf(10));
+    CHECK(method.lambdaCount == 1);
+    auto lambda = instructions(method.lambdas[0]);
+    CHECK(lambda[0].opcode == Opcode::JBW && lambda[0].getJumpTarget() == 0);
+
+    // The module is valid ELP
+    auto bytes = encode(elp);
+    CHECK(encode(ElpReader(std::span<const std::byte>(bytes)).readModule().getInfo()) == bytes);
+    // Assembling again with the same assembler gives the same module
+    CHECK(encode(assembler.assemble(PROGRAM).getInfo()) == bytes);
+}
+
+static void checkError(const char *source, uint32 line) {
+    try {
+        Assembler().assemble(source);
+    } catch (const errors::AssemblyError &error) {
+        CHECK(error.getLine() == line);
+        return;
+    }
+    fprintf(stderr, "no error for: %s\n", source);
+    exit(1);
+}
+
+static void testErrors() {
+    // Jumps to labels that are never defined or lie the wrong way are reported at the jump
+    checkError(".method m\n jfw nowhere\n.end\n", 2);
+    checkError(".method m\nl:\n jfw l\n.end\n", 3);
+    checkError(".method m\n jbw l\n nop\nl:\n.end\n", 2);
+    checkError(".method m\n bogus\n.end\n", 2);
+    checkError(".method m\n aload 300\n.end\n", 2);
+    checkError("nop\n", 1);
+    checkError(".method m\n const \"abc\n.end\n", 2);
+    checkError(".method m\n nop extra\n.end\n", 2);
+    // The 257th constant does not fit the operand of const
+    string source = ".method m\n";
+    for (int i = 0; i < 257; ++i) source += format(" constl %d\n", i);
+    source += " const 256\n.end\n";
+    checkError(source.c_str(), 259);
+}
+
+/// Bytes outside ASCII make a bare symbol, not a number
+static void testNonAscii() {
+    ElpModule module = Assembler().assemble(".method m\n const \xff\xfe\n.end\n");
+    const ElpInfo &elp = module.getInfo();
+    const CpInfo &constant = elp.constantPool[elp.objects[0]._method.code[1]];
+    CHECK(constant.tag == 0x06 && constant._string.len == 2 && constant._string.bytes[0] == 0xFF);
+}
+
+int main() {
+    testJumps();
+    testErrors();
+    testNonAscii();
+    puts("ok");
+}
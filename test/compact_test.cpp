@@ -0,0 +1,92 @@
+#include "test.hpp"
+
+/// Collects the constant behind every reference to the constant pool, in a fixed order
+class References {
+  private:
+    const ElpInfo &elp;
+
+    void add(cpidx index) { constants.push_back(elp.constantPool[index]); }
+
+    void add(const MethodInfo &method) {
+        add(method.thisMethod);
+        for (int i = 0; i < method.typeParamCount; ++i) add(method.typeParams[i].name);
+        for (int i = 0; i < method.argsCount; ++i) {
+            add(method.args[i].thisArg);
+            add(method.args[i].type);
+        }
+        for (int i = 0; i < method.localsCount; ++i) {
+            add(method.locals[i].thisLocal);
+            add(method.locals[i].type);
+        }
+        for (const Instruction &instruction: Bytecode(method.code, method.codeCount)) {
+            if (instruction.isConstPoolRef) add(instruction.operand);
+        }
+        for (int i = 0; i < method.exceptionTableCount; ++i) add(method.exceptionTable[i].exception);
+        for (int i = 0; i < method.lambdaCount; ++i) add(method.lambdas[i]);
+        for (int i = 0; i < method.matchCount; ++i) {
+            for (int j = 0; j < method.matches[i].caseCount; ++j) add(method.matches[i].cases[j].value);
+        }
+    }
+
+    void add(const ObjInfo &obj) {
+        if (obj.type == 0x01) {
+            add(obj._method);
+            return;
+        }
+        const ClassInfo &klass = obj._class;
+        add(klass.thisClass);
+        for (int i = 0; i < klass.typeParamCount; ++i) add(klass.typeParams[i].name);
+        add(klass.supers);
+        for (int i = 0; i < klass.fieldsCount; ++i) {
+            add(klass.fields[i].thisField);
+            add(klass.fields[i].type);
+        }
+        for (int i = 0; i < klass.methodsCount; ++i) add(klass.methods[i]);
+        for (int i = 0; i < klass.objectsCount; ++i) add(klass.objects[i]);
+    }
+
+  public:
+    vector<CpInfo> constants;
+
+    explicit References(const ElpInfo &elp) : elp(elp) {
+        for (cpidx index: {elp.compiledFrom, elp.thisModule, elp.init, elp.entry, elp.imports}) add(index);
+        for (int i = 0; i < elp.globalsCount; ++i) {
+            add(elp.globals[i].thisGlobal);
+            add(elp.globals[i].type);
+        }
+        for (int i = 0; i < elp.objectsCount; ++i) add(elp.objects[i]);
+    }
+};
+
+static void testCompaction(uint16 constants) {
+    ElpModule module = ModuleBuilder(constants).build(200, constants);
+    ElpInfo &elp = module.getInfo();
+    // Copies of earlier entries, which compaction merges
+    for (int i = 5; i < elp.constantPoolCount; i += 5) elp.constantPool[i] = elp.constantPool[i / 3];
+    References before{elp};
+    uint16 count = elp.constantPoolCount;
+
+    CompactionStats stats = compactConstantPool(elp);
+    CHECK(stats.merged > 0);
+    CHECK(elp.constantPoolCount == count - stats.merged - stats.dropped);
+    References after{elp};
+    CHECK(before.constants.size() == after.constants.size());
+    for (size_t i = 0; i < before.constants.size(); ++i) CHECK(before.constants[i] == after.constants[i]);
+    for (int i = 0; i < elp.constantPoolCount; ++i) {
+        for (int j = 0; j < i; ++j) CHECK(!(elp.constantPool[i] == elp.constantPool[j]));
+    }
+
+    // Compacting again finds nothing, and the result survives a round trip
+    auto bytes = encode(elp);
+    stats = compactConstantPool(elp);
+    CHECK(stats.merged == 0 && stats.dropped == 0);
+    CHECK(encode(elp) == bytes);
+    CHECK(encode(ElpReader(std::span<const std::byte>(bytes)).readModule().getInfo()) == bytes);
+}
+
+int main() {
+    testCompaction(50);
+    // Operands of both widths
+    testCompaction(1000);
+    puts("ok");
+}
@@ -0,0 +1,63 @@
+#include "test.hpp"
+#include <set>
+
+static void collectNames(const ObjInfo &obj, std::set<cpidx> &names) {
+    if (obj.type == 0x01) {
+        names.insert(obj._method.thisMethod);
+        return;
+    }
+    for (int i = 0; i < obj._class.methodsCount; ++i) names.insert(obj._class.methods[i].thisMethod);
+    for (int i = 0; i < obj._class.objectsCount; ++i) collectNames(obj._class.objects[i], names);
+}
+
+/**
+ * Replaces a top level method with two other methods of the module in turn,
+ * and checks the file reads back as the patched module each time
+ */
+static void testPatch(bool tableOfContents, bool compression, bool varint) {
+    ElpModule module = ModuleBuilder(8).build(100, 300);
+    ElpInfo &elp = module.getInfo();
+    if (varint) elp.minorVersion |= ELP_MINOR_VARINT;
+    vector<int> methods;
+    for (int i = 0; i < elp.objectsCount; ++i) {
+        if (elp.objects[i].type == 0x01) methods.push_back(i);
+    }
+    CHECK(methods.size() >= 3);
+    // Give the target a name no other method has, so it is the one found
+    std::set<cpidx> names;
+    for (int i = 0; i < elp.objectsCount; ++i) collectNames(elp.objects[i], names);
+    cpidx name = 0;
+    while (names.count(name) != 0) name++;
+    CHECK(name < elp.constantPoolCount);
+    MethodInfo &target = elp.objects[methods[1]]._method;
+    target.thisMethod = name;
+
+    string path = tempPath("patch.elp");
+    {
+        ElpWriter writer{path};
+        writer.setTableOfContents(tableOfContents);
+        writer.setCompression(compression);
+        writer.write(elp);
+    }
+
+    for (int replacement: {methods[0], methods[2]}) {
+        MethodInfo method = elp.objects[replacement]._method;
+        method.thisMethod = name;
+        CHECK(patchMethod(path, name, method));
+        target = method;
+        ElpReader reader{path, ElpReader::Mode::MAPPED};
+        CHECK((reader.getToc() != null) == tableOfContents);
+        CHECK(encode(reader.readModule().getInfo()) == encode(elp));
+    }
+    CHECK(!patchMethod(path, "no such method", target));
+    remove(path.c_str());
+}
+
+int main() {
+    for (bool tableOfContents: {false, true}) {
+        for (bool compression: {false, true}) {
+            for (bool varint: {false, true}) testPatch(tableOfContents, compression, varint);
+        }
+    }
+    puts("ok");
+}
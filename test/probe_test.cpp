@@ -0,0 +1,58 @@
+#include "test.hpp"
+
+static string toString(const __UTF8 &utf8) {
+    return {reinterpret_cast<const char *>(utf8.bytes), utf8.len};
+}
+
+/// The names sit behind more than one block of constants, so probing has to read further
+static void testLargeConstantPool() {
+    ElpModule module = ModuleBuilder(3).build(10, 2000);
+    ElpInfo &elp = module.getInfo();
+    cpidx last = 0;
+    for (cpidx i = 0; i < elp.constantPoolCount; ++i) {
+        if (elp.constantPool[i].tag == 0x06) last = i;
+    }
+    CHECK(last > 1000);
+    elp.thisModule = elp.entry = last;
+    string path = tempPath("probe.elp");
+    ElpWriter(path).write(elp);
+
+    ElpHeader header = ElpReader::probe(path);
+    CHECK(header.magic == elp.magic && header.thisModule == last && header.entry == last);
+    CHECK(header.thisModuleName == toString(elp.constantPool[last]._string));
+    CHECK(header.entryName == header.thisModuleName);
+    remove(path.c_str());
+}
+
+static void testUnreadable() {
+    string directory = tempPath("probe_dir");
+    std::filesystem::create_directories(directory);
+    CHECK_THROWS(ElpReader::probe(directory), errors::IOError);
+    std::filesystem::remove(directory);
+
+    CHECK_THROWS(ElpReader::probe(tempPath("probe_missing.elp")), errors::FileNotFoundError);
+}
+
+static void testCorrupt() {
+    string path = tempPath("probe_corrupt.elp");
+    FILE *file = fopen(path.c_str(), "wb");
+    fclose(file);
+    CHECK_THROWS(ElpReader::probe(path), errors::CorruptFileError);
+
+    // Cut off in the middle of the constant pool, in front of the module name
+    ElpModule module = ModuleBuilder(4).build(10, 2000);
+    module.getInfo().thisModule = 1999;
+    auto bytes = encode(module.getInfo());
+    file = fopen(path.c_str(), "wb");
+    fwrite(bytes.data(), 1, 10000, file);
+    fclose(file);
+    CHECK_THROWS(ElpReader::probe(path), errors::CorruptFileError);
+    remove(path.c_str());
+}
+
+int main() {
+    testLargeConstantPool();
+    testUnreadable();
+    testCorrupt();
+    puts("ok");
+}
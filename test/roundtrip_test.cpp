@@ -0,0 +1,142 @@
+#include "test.hpp"
+
+/// How a module is written
+struct Variant {
+    const char *name;
+    bool tableOfContents;
+    bool compression;
+    /// Whether indices and lengths are written as varints, see ELP_MINOR_VARINT
+    bool varint;
+};
+
+static const Variant VARIANTS[] = {
+        {"plain",              false, false, false},
+        {"toc",                true,  false, false},
+        {"compressed",         false, true,  false},
+        {"compressed_toc",     true,  true,  false},
+        {"varint",             false, false, true },
+        {"varint_toc",         true,  false, true },
+        {"varint_compressed",  false, true,  true },
+};
+
+/// Reads the module back every way there is and checks each gives the module that was written
+static void checkReads(const string &path, const vector<std::byte> &bytes, const vector<std::byte> &expected, const Variant &variant) {
+    auto check = [&](ElpModule module, const char *how) {
+        if (encode(module.getInfo()) != expected) {
+            fprintf(stderr, "%s: %s differs\n", variant.name, how);
+            exit(1);
+        }
+    };
+    for (auto mode: {ElpReader::Mode::STREAM, ElpReader::Mode::MAPPED}) {
+        check(ElpReader(path, mode).readModule(), "readModule");
+        check(ElpReader(path, mode).readParallel(3), "readParallel");
+        ElpModule lazy = ElpReader(path, mode).readLazy();
+        lazy.loadAll();
+        check(std::move(lazy), "readLazy");
+    }
+    check(ElpReader(std::span<const std::byte>(bytes)).readModule(), "readModule from memory");
+    check(ElpReader(std::span<const std::byte>(bytes)).readParallel(2), "readParallel from memory");
+    ElpModule lazy = ElpReader(std::span<const std::byte>(bytes)).readLazy();
+    lazy.loadAll();
+    check(std::move(lazy), "readLazy from memory");
+}
+
+static void checkToc(const string &path, const ElpInfo &elp, bool expected) {
+    ElpReader reader{path, ElpReader::Mode::MAPPED};
+    const TocInfo *toc = reader.getToc();
+    CHECK((toc != null) == expected);
+    if (toc != null) {
+        // The sections tile the module in order
+        CHECK(toc->constantPool.offset + toc->constantPool.length == toc->globals.offset);
+        CHECK(toc->globals.offset + toc->globals.length == toc->objects.offset);
+        CHECK(toc->objectSections.size() == elp.objectsCount);
+        size_t offset = toc->objects.offset;
+        for (auto section: toc->objectSections) {
+            CHECK(section.offset >= offset);
+            offset = section.offset + section.length;
+        }
+        CHECK(offset <= toc->meta.offset && toc->objects.offset + toc->objects.length == toc->meta.offset);
+    }
+    // Methods are found with or without a table of contents
+    for (int i = 0; i < elp.objectsCount; ++i) {
+        const ObjInfo &obj = elp.objects[i];
+        if (obj.type == 0x01) CHECK(reader.findMethod(obj._method.thisMethod).has_value());
+    }
+}
+
+static void testRoundTrip(const Variant &variant, uint16 objects, uint16 constants, size_t codeSize = 0) {
+    ElpModule module = ModuleBuilder(objects * 31 + constants).build(objects, constants, codeSize);
+    if (variant.varint) {
+        auto fixed = encode(module.getInfo());
+        module.getInfo().minorVersion |= ELP_MINOR_VARINT;
+        CHECK(serializedSize(module.getInfo()) < fixed.size() || objects == 0);
+    }
+    const ElpInfo &elp = module.getInfo();
+    auto expected = encode(elp);
+
+    string path = tempPath(format("roundtrip_%s.elp", variant.name));
+    vector<std::byte> bytes;
+    {
+        ElpWriter writer{path};
+        writer.setTableOfContents(variant.tableOfContents);
+        writer.setCompression(variant.compression);
+        writer.write(elp);
+        writer.close();
+        ElpWriter memory{bytes};
+        memory.setTableOfContents(variant.tableOfContents);
+        memory.setCompression(variant.compression);
+        memory.write(elp);
+    }
+    CHECK(readFile(path) == bytes);
+    CHECK(CompressedElp::isCompressed(bytes) == variant.compression);
+    if (variant.compression) {
+        CompressedElp compressed{bytes};
+        CHECK(compressed.getSize() == serializedSize(elp, variant.tableOfContents));
+        CHECK(compressed.decompress(2) == encode(elp, variant.tableOfContents));
+    }
+    checkReads(path, bytes, expected, variant);
+    checkToc(path, elp, variant.tableOfContents);
+    ElpHeader header = ElpReader::probe(path);
+    CHECK(header.minorVersion == elp.minorVersion && header.thisModule == elp.thisModule && header.entry == elp.entry);
+    remove(path.c_str());
+}
+
+/// Frame tables that do not add up are rejected before anything is decompressed
+static void testCorruptFrames() {
+    ElpModule module = ModuleBuilder(7).build(200, 300);
+    auto bytes = compressElp(module.getInfo());
+    CHECK(CompressedElp(bytes).getSize() == serializedSize(module.getInfo()));
+    auto data = reinterpret_cast<uint8 *>(bytes.data());
+    uint32 count = loadBigEndian<ui4>(data + 8);
+    CHECK(count > 0);
+    uint8 *frame = data + 12;
+    CHECK(loadBigEndian<ui4>(frame + 4) < loadBigEndian<ui4>(frame));
+
+    // More than a compressed block of that size can expand to
+    auto corrupt = bytes;
+    storeBigEndian<ui4>(reinterpret_cast<uint8 *>(corrupt.data()) + 12, 0xFFFFFFF0);
+    CHECK_THROWS(CompressedElp{corrupt}, errors::CorruptFileError);
+    CHECK_THROWS(ElpReader{std::span<const std::byte>(corrupt)}, errors::CorruptFileError);
+
+    // Stored data that does not match the file size
+    corrupt = bytes;
+    corrupt.pop_back();
+    CHECK_THROWS(CompressedElp{corrupt}, errors::CorruptFileError);
+
+    // Frame data that does not decompress
+    corrupt = bytes;
+    for (size_t i = 12 + count * 8; i < corrupt.size(); i += 3) corrupt[i] = std::byte(0xFF);
+    CHECK_THROWS(ElpReader(std::span<const std::byte>(corrupt)).readModule(), errors::CorruptFileError);
+}
+
+int main() {
+    for (const Variant &variant: VARIANTS) {
+        testRoundTrip(variant, 0, 1);
+        testRoundTrip(variant, 200, 100);
+        testRoundTrip(variant, 300, 1000);
+        // Methods larger than the read buffer
+        testRoundTrip(variant, 8, 300, 200 * 1024);
+    }
+    testCorruptFrames();
+    puts("ok");
+}
@@ -0,0 +1,247 @@
+#ifndef SPUTILS_TEST_TEST_HPP
+#define SPUTILS_TEST_TEST_HPP
+
+#include "../src/sputils.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+
+/// Fails the test with the location and text of the condition if it does not hold
+#define CHECK(cond)                                                                                                                            \
+    do {                                                                                                                                       \
+        if (!(cond)) {                                                                                                                         \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                                          \
+            exit(1);                                                                                                                           \
+        }                                                                                                                                      \
+    } while (false)
+
+/// Fails the test unless the statement throws the exception
+#define CHECK_THROWS(statement, exception)                                                                                                     \
+    do {                                                                                                                                       \
+        bool thrown = false;                                                                                                                   \
+        try {                                                                                                                                  \
+            statement;                                                                                                                         \
+        } catch (const exception &) {                                                                                                          \
+            thrown = true;                                                                                                                     \
+        }                                                                                                                                      \
+        CHECK(thrown && #statement " throws " #exception);                                                                                     \
+    } while (false)
+
+/**
+ * @return a path for a scratch file of the test in the temporary directory
+ */
+inline string tempPath(const string &name) {
+    return (std::filesystem::temp_directory_path() / ("sputils_test_" + name)).string();
+}
+
+/**
+ * @return the bytes of a file
+ */
+inline vector<std::byte> readFile(const string &path) {
+    vector<std::byte> bytes;
+    readFileHead(path, bytes, SIZE_MAX);
+    return bytes;
+}
+
+/**
+ * Builds random but well formed modules, every index into the constant pool is valid
+ * and the code consists of whole instructions, so modules can be round tripped,
+ * compacted and iterated over. The same seed always gives the same module
+ */
+class ModuleBuilder {
+  private:
+    std::mt19937 rng;
+    ElpModule module;
+    Arena &arena;
+    uint16 constantPoolCount = 1;
+
+    uint32 random(uint32 bound) { return bound == 0 ? 0 : rng() % bound; }
+
+    cpidx index() { return random(constantPoolCount); }
+
+    __UTF8 utf8(size_t maxLength) {
+        __UTF8 str{};
+        str.len = random(maxLength);
+        str.bytes = arena.alloc<ui1>(str.len);
+        for (int i = 0; i < str.len; ++i) str.bytes[i] = 'a' + random(26);
+        return str;
+    }
+
+    MetaInfo meta() {
+        MetaInfo meta{};
+        meta.len = random(3);
+        meta.table = arena.alloc<MetaInfo::__meta>(meta.len);
+        for (int i = 0; i < meta.len; ++i) meta.table[i] = {utf8(8), utf8(8)};
+        return meta;
+    }
+
+    CpInfo constant(int depth) {
+        CpInfo cp{};
+        switch (random(depth > 0 ? 4 : 5)) {
+            case 0:
+                cp.tag = 0x03;
+                cp._char = random(0x110000);
+                break;
+            case 1:
+                cp.tag = 0x04;
+                cp._int = uint64(rng()) << 32 | rng();
+                break;
+            case 2:
+                cp.tag = 0x05;
+                cp._float = uint64(rng()) << 32 | rng();
+                break;
+            case 3:
+                cp.tag = 0x06;
+                cp._string = utf8(24);
+                break;
+            default:
+                cp.tag = 0x07;
+                cp._array.len = random(4);
+                cp._array.items = arena.alloc<CpInfo>(cp._array.len);
+                for (int i = 0; i < cp._array.len; ++i) cp._array.items[i] = constant(depth + 1);
+        }
+        return cp;
+    }
+
+    void code(MethodInfo &method, size_t size) {
+        ui1 *code = arena.alloc<ui1>(size + 3);
+        size_t pc = 0;
+        while (pc < size) {
+            auto opcode = static_cast<Opcode>(random(static_cast<uint32>(Opcode::NUM_OPCODES)));
+            int params = OpcodeInfo::getParams(opcode);
+            if (opcode == Opcode::CLOSURELOAD || pc + 1 + params > size) {
+                code[pc++] = static_cast<ui1>(Opcode::NOP);
+                continue;
+            }
+            code[pc++] = static_cast<ui1>(opcode);
+            uint32 operand = random(1 << 16);
+            if (OpcodeInfo::takeFromConstPool(opcode)) {
+                operand = index() % (params == 1 ? std::min<uint32>(constantPoolCount, 256) : constantPoolCount);
+            }
+            if (params == 1) {
+                code[pc++] = static_cast<ui1>(operand);
+            } else if (params == 2) {
+                storeBigEndian<ui2>(code + pc, operand);
+                pc += 2;
+            }
+        }
+        method.code = code;
+        method.codeCount = size;
+    }
+
+    MethodInfo method(int depth, size_t codeSize) {
+        MethodInfo method{};
+        method.accessFlags = random(1 << 16);
+        method.type = random(4);
+        method.thisMethod = index();
+        method.typeParamCount = random(3);
+        method.typeParams = arena.alloc<TypeParamInfo>(method.typeParamCount);
+        for (int i = 0; i < method.typeParamCount; ++i) method.typeParams[i].name = index();
+        method.argsCount = random(3);
+        method.args = arena.alloc<MethodInfo::ArgInfo>(method.argsCount);
+        for (int i = 0; i < method.argsCount; ++i) method.args[i] = {index(), index(), meta()};
+        method.localsCount = random(4);
+        method.closureStart = random(method.localsCount + 1);
+        method.locals = arena.alloc<MethodInfo::LocalInfo>(method.localsCount);
+        for (int i = 0; i < method.localsCount; ++i) method.locals[i] = {index(), index(), meta()};
+        method.maxStack = random(64);
+        code(method, codeSize != 0 ? codeSize : random(48));
+        method.exceptionTableCount = random(3);
+        method.exceptionTable = arena.alloc<MethodInfo::ExceptionTableInfo>(method.exceptionTableCount);
+        for (int i = 0; i < method.exceptionTableCount; ++i) {
+            method.exceptionTable[i] = {random(method.codeCount), random(method.codeCount), random(method.codeCount), index(), meta()};
+        }
+        method.lineInfo.numberCount = random(5);
+        method.lineInfo.numbers = arena.alloc<MethodInfo::LineInfo::NumberInfo>(method.lineInfo.numberCount);
+        for (int i = 0; i < method.lineInfo.numberCount; ++i) method.lineInfo.numbers[i] = {static_cast<ui1>(random(8)), random(100000)};
+        method.lambdaCount = depth < 2 ? random(2) : 0;
+        method.lambdas = arena.alloc<MethodInfo>(method.lambdaCount);
+        for (int i = 0; i < method.lambdaCount; ++i) method.lambdas[i] = this->method(depth + 1, 0);
+        method.matchCount = random(2);
+        method.matches = arena.alloc<MethodInfo::MatchInfo>(method.matchCount);
+        for (int i = 0; i < method.matchCount; ++i) {
+            MethodInfo::MatchInfo &match = method.matches[i];
+            match.caseCount = random(3);
+            match.cases = arena.alloc<MethodInfo::MatchInfo::CaseInfo>(match.caseCount);
+            for (int j = 0; j < match.caseCount; ++j) match.cases[j] = {index(), random(method.codeCount)};
+            match.defaultLocation = random(method.codeCount);
+            match.meta = meta();
+        }
+        method.meta = meta();
+        return method;
+    }
+
+    ObjInfo object(int depth) {
+        ObjInfo obj{};
+        if (depth > 1 || random(2) == 0) {
+            obj.type = 0x01;
+            obj._method = method(0, 0);
+            return obj;
+        }
+        obj.type = 0x02;
+        ClassInfo &klass = obj._class;
+        klass.type = random(3);
+        klass.accessFlags = random(1 << 16);
+        klass.thisClass = index();
+        klass.typeParamCount = random(2);
+        klass.typeParams = arena.alloc<TypeParamInfo>(klass.typeParamCount);
+        for (int i = 0; i < klass.typeParamCount; ++i) klass.typeParams[i].name = index();
+        klass.supers = index();
+        klass.fieldsCount = random(3);
+        klass.fields = arena.alloc<FieldInfo>(klass.fieldsCount);
+        for (int i = 0; i < klass.fieldsCount; ++i) klass.fields[i] = {static_cast<ui2>(random(1 << 16)), index(), index(), meta()};
+        klass.methodsCount = random(4);
+        klass.methods = arena.alloc<MethodInfo>(klass.methodsCount);
+        for (int i = 0; i < klass.methodsCount; ++i) klass.methods[i] = method(0, 0);
+        klass.objectsCount = random(3);
+        klass.objects = arena.alloc<ObjInfo>(klass.objectsCount);
+        for (int i = 0; i < klass.objectsCount; ++i) klass.objects[i] = object(depth + 1);
+        klass.meta = meta();
+        return obj;
+    }
+
+  public:
+    explicit ModuleBuilder(unsigned seed) : rng(seed), module(1024 * 1024), arena(module.getArena()) {}
+
+    /**
+     * Builds the module
+     * @param objects number of top level objects
+     * @param constants number of constants, 300 or more gives operands of both widths
+     * @param codeSize size of the code of every top level method, 0 for small random sizes
+     * @return the module, the builder must not be used afterwards
+     */
+    ElpModule build(uint16 objects, uint16 constants, size_t codeSize = 0) {
+        ElpInfo &elp = module.getInfo();
+        elp.magic = 0xC0FFEEDE;
+        elp.minorVersion = 1;
+        elp.majorVersion = 1;
+        constantPoolCount = std::max(constants, uint16(1));
+        elp.constantPoolCount = constantPoolCount;
+        elp.constantPool = arena.alloc<CpInfo>(constantPoolCount);
+        for (int i = 0; i < constantPoolCount; ++i) elp.constantPool[i] = constant(0);
+        elp.compiledFrom = index();
+        elp.type = random(3);
+        elp.thisModule = index();
+        elp.init = index();
+        elp.entry = index();
+        elp.imports = index();
+        elp.globalsCount = random(5);
+        elp.globals = arena.alloc<GlobalInfo>(elp.globalsCount);
+        for (int i = 0; i < elp.globalsCount; ++i) elp.globals[i] = {static_cast<ui1>(random(4)), index(), index(), meta()};
+        elp.objectsCount = objects;
+        elp.objects = arena.alloc<ObjInfo>(objects);
+        for (int i = 0; i < objects; ++i) {
+            if (codeSize == 0) {
+                elp.objects[i] = object(0);
+            } else {
+                elp.objects[i].type = 0x01;
+                elp.objects[i]._method = method(2, codeSize);
+            }
+        }
+        elp.meta = meta();
+        return std::move(module);
+    }
+};
+
+#endif    // SPUTILS_TEST_TEST_HPP
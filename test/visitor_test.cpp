@@ -0,0 +1,107 @@
+#include "test.hpp"
+
+/// Counts what a module holds
+class CountingVisitor : public ElpVisitor {
+  public:
+    bool meta = true;
+    bool bodies = true;
+    size_t constants = 0, globals = 0, classes = 0, classEnds = 0, fields = 0, methods = 0, codes = 0, codeBytes = 0, metas = 0;
+
+    bool visitMeta() const override { return meta; }
+
+    void onConstant(cpidx /*index*/, const CpInfo & /*constant*/) override { constants++; }
+
+    void onGlobal(const GlobalInfo & /*global*/) override { globals++; }
+
+    bool onClassBegin(const ClassInfo & /*klass*/) override {
+        classes++;
+        return true;
+    }
+
+    void onField(const FieldInfo & /*field*/) override { fields++; }
+
+    void onClassEnd(const ClassInfo & /*klass*/) override { classEnds++; }
+
+    bool onMethod(const MethodInfo & /*method*/) override {
+        methods++;
+        return bodies;
+    }
+
+    void onCode(const MethodInfo &method) override {
+        codes++;
+        codeBytes += method.codeCount;
+    }
+
+    void onMeta(const MetaInfo & /*meta*/) override { metas++; }
+};
+
+static void count(const MethodInfo &method, CountingVisitor &expected) {
+    expected.methods++;
+    expected.codes++;
+    expected.codeBytes += method.codeCount;
+}
+
+static void count(const ObjInfo &obj, CountingVisitor &expected) {
+    if (obj.type == 0x01) {
+        count(obj._method, expected);
+        return;
+    }
+    expected.classes++;
+    expected.classEnds++;
+    expected.fields += obj._class.fieldsCount;
+    for (int i = 0; i < obj._class.methodsCount; ++i) count(obj._class.methods[i], expected);
+    for (int i = 0; i < obj._class.objectsCount; ++i) count(obj._class.objects[i], expected);
+}
+
+static void testCounts(bool varint) {
+    ElpModule module = ModuleBuilder(1).build(500, 300);
+    if (varint) module.getInfo().minorVersion |= ELP_MINOR_VARINT;
+    const ElpInfo &elp = module.getInfo();
+    string path = tempPath("visitor.elp");
+    ElpWriter(path).write(elp);
+    CountingVisitor expected;
+    for (int i = 0; i < elp.objectsCount; ++i) count(elp.objects[i], expected);
+
+    for (auto mode: {ElpReader::Mode::STREAM, ElpReader::Mode::MAPPED}) {
+        for (bool meta: {false, true}) {
+            for (bool bodies: {false, true}) {
+                ElpReader reader{path, mode};
+                CountingVisitor visitor;
+                visitor.meta = meta;
+                visitor.bodies = bodies;
+                reader.accept(visitor);
+                CHECK(visitor.constants == elp.constantPoolCount);
+                CHECK(visitor.globals == elp.globalsCount);
+                CHECK(visitor.classes == expected.classes && visitor.classEnds == expected.classEnds);
+                CHECK(visitor.fields == expected.fields);
+                // Lambdas are part of the body of their method rather than visited on their own
+                CHECK(visitor.methods == expected.methods);
+                CHECK(visitor.codes == (bodies ? expected.codes : 0));
+                CHECK(visitor.codeBytes == (bodies ? expected.codeBytes : 0));
+                CHECK(visitor.metas == (meta ? 1 : 0));
+            }
+        }
+    }
+    remove(path.c_str());
+}
+
+/// Streaming a module made of large methods must keep memory bounded by the largest method
+static void testLargeMethods() {
+    ElpModule module = ModuleBuilder(2).build(64, 300, 150 * 1024);
+    string path = tempPath("visitor_large.elp");
+    ElpWriter(path).write(module.getInfo());
+    for (auto mode: {ElpReader::Mode::STREAM, ElpReader::Mode::MAPPED}) {
+        ElpReader reader{path, mode};
+        CountingVisitor visitor;
+        reader.accept(visitor);
+        CHECK(visitor.codeBytes >= 64 * 150 * 1024);
+    }
+    remove(path.c_str());
+}
+
+int main() {
+    testCounts(false);
+    testCounts(true);
+    testLargeMethods();
+    puts("ok");
+}
@@ -0,0 +1,41 @@
+#include "test.hpp"
+
+/// Every way of writing a module gives the same bytes
+static void testOutputsAgree() {
+    ElpModule module = ModuleBuilder(5).build(300, 400);
+    const ElpInfo &elp = module.getInfo();
+    auto encoded = encode(elp);
+    CHECK(encoded.size() == serializedSize(elp));
+    CHECK(encodeParallel(elp, 4) == encoded);
+
+    vector<std::byte> output;
+    ElpWriter(output).write(elp);
+    CHECK(output == encoded);
+
+    string path = tempPath("writer.elp");
+    {
+        ElpWriter writer{path};
+        writer.writeParallel(elp, 3);
+        writer.close();
+    }
+    CHECK(readFile(path) == encoded);
+    remove(path.c_str());
+}
+
+static void testWriteAfterClose() {
+    ElpModule module = ModuleBuilder(6).build(5, 20);
+    string path = tempPath("writer_closed.elp");
+    ElpWriter writer{path};
+    writer.write(module.getInfo());
+    writer.close();
+    CHECK_THROWS(writer.write(module.getInfo()), errors::IOError);
+    CHECK_THROWS(writer.writeParallel(module.getInfo()), errors::IOError);
+    CHECK(readFile(path) == encode(module.getInfo()));
+    remove(path.c_str());
+}
+
+int main() {
+    testOutputsAgree();
+    testWriteAfterClose();
+    puts("ok");
+}